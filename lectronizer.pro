@@ -1,4 +1,4 @@
-QT       += charts core gui network widgets sql
+QT       += charts concurrent core gui network widgets sql
 CONFIG   += c++20
 
 SOURCES += \
@@ -6,9 +6,15 @@ SOURCES += \
     main.cpp \
     orderitemdelegate.cpp \
     ordermanager.cpp \
+    orderpageparser.cpp \
+    ordersearchindex.cpp \
+    ordersnapshot.cpp \
+    orderstreamparser.cpp \
     ordersortfiltermodel.cpp \
+    requestscheduler.cpp \
     sqlmanager.cpp \
     structs.cpp \
+    trackingimporter.cpp \
     utils.cpp \
     widgets/bulkexporterdialog.cpp \
     widgets/clickylineedit.cpp \
@@ -32,10 +38,16 @@ HEADERS += \
     filterbuttondelegate.h \
     orderitemdelegate.h \
     ordermanager.h \
+    orderpageparser.h \
+    ordersearchindex.h \
+    ordersnapshot.h \
+    orderstreamparser.h \
     ordersortfiltermodel.h \
+    requestscheduler.h \
     shareddata.h \
     sqlmanager.h \
     structs.h \
+    trackingimporter.h \
     utils.h \
     widgets/bulkexporterdialog.h \
     widgets/clickylineedit.h \
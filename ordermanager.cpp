@@ -1,8 +1,10 @@
 #include "ordermanager.h"
+#include "ordersnapshot.h"
 #include "shareddata.h"
 #include "sqlmanager.h"
 
 #include <QApplication>
+#include <QFutureWatcher>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -10,15 +12,134 @@
 #include <QMessageBox>
 #include <QNetworkReply>
 #include <QProgressDialog>
+#include <QRandomGenerator>
 #include <QThread>
 #include <QTimer>
 #include <QUrl>
 #include <QUrlQuery>
+#include <QtConcurrentRun>
 
-static const int FetchSize = 150;
+static const int DefaultPageSize = 150;
+
+// a page size change has to make at least this much difference to be worth it
+static const double ThroughputTolerance = 0.1;
+
+// failed requests are retried with a growing delay, this many times at most
+static const int MaxRetries = 5;
+static const int RetryBaseDelayMs = 1000;
+static const int RetryMaxDelayMs = 60 * 1000;
+static const int RetryAfterMaxMs = 10 * 60 * 1000;
+
+// how often the queued changes are sent again while the server is unreachable
+static const int ReplayIntervalMs = 30 * 1000;
+
+static const QString SyncMarkKey = "orders_updated_at";
+static const QString FullSyncKey = "orders_full_sync_at";
+static const QString PageSizeKey = "orders_page_size";
 
 QString OrderManager::ApiUrl{"https://lectronz.com/api/v1/orders"};
 
+static bool isNotModified(const QNetworkReply *reply)
+{
+    return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304;
+}
+
+static bool isCacheable(const QNetworkReply *reply)
+{
+    return reply->hasRawHeader("ETag") || reply->hasRawHeader("Last-Modified");
+}
+
+static bool isRateLimited(const QNetworkReply *reply)
+{
+    return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 429;
+}
+
+static bool isRetryable(const QNetworkReply *reply)
+{
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((status == 429) || (status >= 500))
+        return true;
+
+    switch (reply->error()) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::InternalServerError:
+    case QNetworkReply::ServiceUnavailableError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::UnknownServerError:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// the local version of what the server does with a change, so it shows up before it's sent
+static void applyMutation(Order &order, const SqlManager::Mutation &mutation)
+{
+    const QJsonObject changes = QJsonDocument::fromJson(mutation.body).object();
+
+    if (changes.contains("status"))
+        order.status = changes.value("status").toString();
+
+    if ((changes.value("status").toString() == "fulfilled") && order.fulfilledAt.isNull())
+        order.fulfilledAt = mutation.createdAt.toLocalTime();
+
+    if (changes.contains("tracking_code"))
+        order.tracking.code = changes.value("tracking_code").toString();
+
+    if (changes.contains("tracking_url"))
+        order.tracking.url = changes.value("tracking_url").toString();
+}
+
+// the non-api fields only ever change here, whatever a page brings along for them can be older
+static void keepLocalProperties(Order &order, const Order &local)
+{
+    order.packaging = local.packaging;
+    order.note = local.note;
+    order.dirty = local.dirty;
+
+    for (int i = 0; i < std::min(order.items.size(), local.items.size()); ++i) {
+        order.items[i].packaged = local.items[i].packaged;
+        order.items[i].dirty = local.items[i].dirty;
+    }
+}
+
+// how long to wait before the next attempt, -1 if the server wants us to stay away for too long
+static int retryDelay(const QNetworkReply *reply, const int attempt)
+{
+    // Retry-After is either a number of seconds or a HTTP date
+    const QByteArray retryAfter = reply->rawHeader("Retry-After").trimmed();
+    if (!retryAfter.isEmpty()) {
+        qint64 delay = -1;
+
+        bool ok = false;
+        const qint64 secs = retryAfter.toLongLong(&ok);
+        if (ok) {
+            delay = secs * 1000;
+        } else {
+            const QDateTime when = QDateTime::fromString(QString::fromLatin1(retryAfter), Qt::RFC2822Date);
+            if (when.isValid())
+                delay = QDateTime::currentDateTimeUtc().msecsTo(when);
+        }
+
+        if (delay > RetryAfterMaxMs)
+            return -1;
+
+        if (delay >= 0)
+            return (int)delay;
+    }
+
+    // exponential backoff, half of it random so we don't come back at the same time as everyone else
+    const int ceiling = std::min(RetryMaxDelayMs, RetryBaseDelayMs << attempt);
+    return ceiling / 2 + (int)QRandomGenerator::global()->bounded(ceiling / 2 + 1);
+}
+
 OrderManager::OrderManager(QNetworkAccessManager *nam, SharedData *shared, SqlManager *sqlMgr, QWidget *parent)
     : QObject(qobject_cast<QObject*>(parent))
     , m_nam{nam}
@@ -32,9 +153,57 @@ OrderManager::OrderManager(QNetworkAccessManager *nam, SharedData *shared, SqlMa
     m_progressDlg->setMinimumDuration(0);
     resetProgressDlg();
 
+    m_pageSize = m_sqlMgr->syncValue(PageSizeKey).toInt();
+    if (m_pageSize <= 0)
+        m_pageSize = DefaultPageSize;
+
+    m_scheduler = new RequestScheduler(this);
+
+    // changes that didn't make it to the server last time
+    m_mutations = m_sqlMgr->mutations();
+
+    m_replayTimer.setInterval(ReplayIntervalMs);
+    connect(&m_replayTimer, &QTimer::timeout, this, &OrderManager::sendMutations);
+    if (!m_mutations.isEmpty()) {
+        m_offline = true;
+        m_replayTimer.start();
+    }
+
+    // parsing and restoring whole pages is slow, so it happens on a worker thread
+    qRegisterMetaType<OrderPage>();
+
+    m_parserThread = new QThread(this);
+    m_parser = new OrderPageParser(m_sqlMgr);
+    m_parser->moveToThread(m_parserThread);
+    connect(m_parserThread, &QThread::finished, m_parser, &QObject::deleteLater);
+    connect(m_parser, &OrderPageParser::pageParsed, this, &OrderManager::processFetch);
+    connect(m_parser, &OrderPageParser::parseFailed, this, [this](const int serial, const QString &error)
+    {
+        if (serial != m_fetchSerial)
+            return;
+
+        setErrorMsg(error);
+    });
+    m_parserThread->start();
+
+    // only local changes are written, what came from the server is in the order store already
     connect(this, &OrderManager::orderUpdated, this, [this](const Order &order)
     {
+        if (!order.isDirty())
+            return;
+
         m_sqlMgr->save(order);
+
+        if (contains(order.id))
+            m_orders[order.id].clearDirty();
+    });
+
+    // keep the search index in step with whatever the rest of the app gets to see
+    connect(this, &OrderManager::ordersReceived, this, &OrderManager::updateSearchIndex);
+    connect(this, &OrderManager::ordersUpdated, this, &OrderManager::updateSearchIndex);
+    connect(this, &OrderManager::orderUpdated, this, [this](const Order &order)
+    {
+        updateSearchIndex({ order });
     });
 
     // Workaround for a bug where the progress dialog is visible on start
@@ -43,22 +212,172 @@ OrderManager::OrderManager(QNetworkAccessManager *nam, SharedData *shared, SqlMa
 
 OrderManager::~OrderManager()
 {
+    m_parserThread->quit();
+    m_parserThread->wait();
+
     delete m_progressDlg;
     m_progressDlg = nullptr;
 }
 
-void OrderManager::refresh(const bool hidden)
+void OrderManager::loadStoredOrders()
+{
+    m_loadTimer.start();
+    m_loadingStored = true;
+
+    // decoding and restoring thousands of orders takes a while, the window can show up meanwhile
+    SqlManager *sqlMgr = m_sqlMgr;
+    auto *watcher = new QFutureWatcher<StoredOrders>(this);
+    connect(watcher, &QFutureWatcher<StoredOrders>::finished, this, [this, watcher]()
+    {
+        finishLoadStoredOrders(watcher->result());
+        watcher->deleteLater();
+    });
+
+    watcher->setFuture(m_sqlMgr->readAsync([sqlMgr]()
+    {
+        StoredOrders stored;
+
+        // the snapshot is only good if nothing was stored since it was written
+        OrderSnapshot snapshot;
+        const qint64 generation = sqlMgr->ordersGeneration();
+        stored.fromSnapshot = snapshot.open(sqlMgr->snapshotPath()) && (snapshot.generation() == generation);
+
+        if (stored.fromSnapshot) {
+            stored.orders.reserve(snapshot.count());
+            for (int i = 0; i < snapshot.count(); ++i)
+                stored.orders << snapshot.order(i);
+
+            stored.generation = generation;
+        } else {
+            stored.orders = sqlMgr->storedOrders();
+        }
+
+        QElapsedTimer restoreTimer;
+        restoreTimer.start();
+        sqlMgr->restore(stored.orders);
+        stored.restoreMsecs = (int)restoreTimer.elapsed();
+
+        stored.hashes = sqlMgr->orderHashes();
+
+        return stored;
+    }));
+}
+
+void OrderManager::finishLoadStoredOrders(const StoredOrders &stored)
+{
+    m_snapshotLoaded = stored.fromSnapshot;
+    if (m_snapshotLoaded)
+        m_snapshotGeneration = stored.generation;
+
+    m_storedOrders = (int)stored.orders.size();
+    m_storeRestoreMsecs = stored.restoreMsecs;
+
+    QList<Order> received;
+    for (Order order : stored.orders) {
+        if (contains(order.id))
+            continue;
+
+        // changes that are still queued were already shown last time
+        if (hasPendingMutations(order.id)) {
+            m_serverOrders.insert(order.id, order);
+            applyPendingMutations(order);
+        }
+
+        m_orders.insert(order.id, order);
+        received << order;
+    }
+
+    if (!received.isEmpty())
+        emit ordersReceived(received);
+
+    // the parser can skip whatever the server sends exactly like last time
+    QHash<int, quint64> hashes = stored.hashes;
+    for (auto it = hashes.begin(); it != hashes.end();) {
+        if (contains(it.key()))
+            ++it;
+        else
+            it = hashes.erase(it);
+    }
+    setParserHashes(hashes);
+
+    m_storeLoadMsecs = (int)m_loadTimer.elapsed();
+    m_loadingStored = false;
+
+    emit storedOrdersLoaded(m_storedOrders);
+
+    if (m_afterLoad) {
+        const std::function<void()> afterLoad = m_afterLoad;
+        m_afterLoad = nullptr;
+        afterLoad();
+    }
+}
+
+void OrderManager::refresh(const bool hidden, const bool fullSync)
 {
+    // the stored orders have to be in first, otherwise every one of them would look new
+    if (m_loadingStored) {
+        m_afterLoad = [this, hidden, fullSync]() { refresh(hidden, fullSync); };
+        return;
+    }
+
+    if (isRefreshing()) {
+        // the user is waiting for it now, so it shouldn't be in the background anymore
+        if (!hidden && (m_fetchPriority == RequestScheduler::Priority::Background)) {
+            m_fetchPriority = RequestScheduler::Priority::Interactive;
+            m_scheduler->promote(RequestScheduler::Priority::Background, m_fetchPriority);
+
+            m_progressDlg->setAutoClose(false);
+            m_progressDlg->setHidden(false);
+            return;
+        }
+
+        qDebug() << "Trying to refresh while previous refresh still active!";
+        return;
+    }
+
     resetProgressDlg();
 
-    m_progressDlg->setAutoClose(hidden);
-    m_progressDlg->setHidden(hidden);
+    // the orders from last time are already there, no need to block the window for the first refresh
+    const bool background = hidden || (m_firstRefresh && !fullSync && !m_orders.isEmpty());
+    m_firstRefresh = false;
+
+    m_progressDlg->setAutoClose(background);
+    m_progressDlg->setHidden(background);
+
+    m_fetchPriority = background ? RequestScheduler::Priority::Background : RequestScheduler::Priority::Interactive;
+    m_scheduler->setMaxActive(m_shared->fetchConcurrency);
 
     m_newOrders = 0;
+    m_restoreMsecs = 0;
+    m_unchangedOrders = 0;
     m_updatedOrders = 0;
 
-    // we fetch the first batch, processFetch() will do the following fetches if needed
-    fetch(0, FetchSize);
+    // settings could have changed since the last time
+    m_pageSize = std::clamp(m_pageSize, std::min(m_shared->fetchSizeMin, m_shared->fetchSizeMax), m_shared->fetchSizeMax);
+
+    m_fetchedPages.clear();
+    m_fetchSerial += 1;
+    m_mergeOffset = 0;
+    m_nextOffset = m_pageSize;
+    m_parsingPages = 0;
+    m_totalOrders = -1;
+
+    m_sampleBytes = 0;
+    m_sampleMsecs = 0;
+    m_sampleOrders = 0;
+    m_samplePages = 0;
+
+    // only walk the pages until we reach orders we've already seen, unless a full resync is due
+    const QDateTime lastFullSync = QDateTime::fromString(m_sqlMgr->syncValue(FullSyncKey), Qt::ISODateWithMs);
+    const bool fullSyncDue = !lastFullSync.isValid() ||
+                             (lastFullSync.secsTo(QDateTime::currentDateTimeUtc()) >= m_shared->fullSyncIntervalHours * 3600);
+
+    m_syncMark = QDateTime::fromString(m_sqlMgr->syncValue(SyncMarkKey), Qt::ISODateWithMs);
+    m_newestUpdate = m_syncMark;
+    m_deltaSync = !fullSync && !fullSyncDue && m_syncMark.isValid() && !m_orders.isEmpty();
+
+    // we fetch the first batch, once we know the total count processFetch() will fetch the rest
+    fetch(0, m_pageSize);
 }
 
 bool OrderManager::contains(const int id) const
@@ -71,11 +390,42 @@ Order &OrderManager::order(const int id)
     return m_orders[id];
 }
 
+bool OrderManager::isRefreshing() const
+{
+    return !m_fetchReplies.isEmpty() || (m_queuedFetches > 0) || (m_parsingPages > 0) || (m_pendingRetries > 0) || (m_totalOrders >= 0);
+}
+
 QList<int> OrderManager::orderIds() const
 {
     return m_orders.keys();
 }
 
+const OrderSearchIndex &OrderManager::searchIndex() const
+{
+    return m_searchIndex;
+}
+
+QStringList OrderManager::diagnostics() const
+{
+    QStringList lines;
+    lines << tr("Page cache: %1 hits, %2 misses, %3 KiB not downloaded").arg(m_cacheHits).arg(m_cacheMisses).arg(m_cacheBytesSaved / 1024);
+    lines << tr("Local store: %1 orders loaded from the %2 in %3 ms, %4 ms of it restoring local properties")
+                 .arg(m_storedOrders)
+                 .arg(m_snapshotLoaded ? tr("snapshot") : tr("database"))
+                 .arg(m_storeLoadMsecs)
+                 .arg(m_storeRestoreMsecs);
+    lines << tr("Page size: %1 orders (%2-%3), %4 orders/s last refresh").arg(m_pageSize).arg(m_shared->fetchSizeMin).arg(m_shared->fetchSizeMax).arg(m_lastThroughput, 0, 'f', 1);
+
+    if (m_samplePages > 0) {
+        lines << tr("Last refresh: %1 unchanged orders skipped without parsing, %2 ms restoring local properties").arg(m_unchangedOrders).arg(m_restoreMsecs);
+        lines << tr("Last refresh: %1 ms and %2 KiB per page on average")
+                     .arg(m_sampleMsecs / m_samplePages)
+                     .arg(m_sampleBytes / m_samplePages / 1024.0, 0, 'f', 1);
+    }
+
+    return lines;
+}
+
 void OrderManager::markShipped(const int id, const QString &trackingNo, const QString &trackingUrl)
 {
     if (!contains(id)) {
@@ -83,80 +433,42 @@ void OrderManager::markShipped(const int id, const QString &trackingNo, const QS
         return;
     }
 
-    if (m_reply) {
-        QMessageBox::warning(nullptr, tr("Bad state"), tr("Can't do while refreshing orders. Please retry after it's done."));
-        return;
-    }
-
-    resetProgressDlg();
-    m_progressDlg->setAutoClose(false);
-    m_progressDlg->setHidden(false);
-
-    QUrl url(ApiUrl + "/" + QString::number(id));
-
-    QNetworkRequest req(url);
-    req.setRawHeader("Content-Type", "application/json");
-    req.setRawHeader("Accept", "*/*");
-    req.setRawHeader("Authorization", QString("Bearer %1").arg(m_shared->apiKey).toUtf8());
-
-    const QJsonObject rootObj({
-        { "status",        "fulfilled" },
-        { "tracking_code", trackingNo  },
-        { "tracking_url",  trackingUrl },
-    });
+    markShipped({ Fulfillment{ id, trackingNo, trackingUrl } });
+}
 
-    m_reply = m_nam->put(req, QJsonDocument(rootObj).toJson(QJsonDocument::Compact));
+void OrderManager::markShipped(const QList<Fulfillment> &fulfillments)
+{
+    QStringList errors;
+    QList<Order> changed;
 
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 15, 0))
-    connect(m_reply, &QNetworkReply::errorOccurred, m_reply, [this]()
-#else
-    connect(m_reply, qOverload<QNetworkReply::NetworkError>(&QNetworkReply::error), m_reply, [this]()
-#endif
-    {
-        if (m_reply->error() == QNetworkReply::AuthenticationRequiredError) {
-            setErrorMsg(tr("Authorization error, maybe double-check your API key!"));
-        } else {
-            setErrorMsg(m_reply->errorString());
+    for (const Fulfillment &fulfillment : fulfillments) {
+        if (!contains(fulfillment.orderId)) {
+            errors << tr("#%1: Order doesn't exist.").arg(fulfillment.orderId);
+            continue;
         }
-    });
 
-    connect(m_reply, &QNetworkReply::sslErrors, m_reply, [this](const QList<QSslError> &errors)
-    {
-        setErrorMsg(errors[0].errorString());
-    });
+        const QJsonObject rootObj({
+            { "status",        "fulfilled"              },
+            { "tracking_code", fulfillment.trackingNo  },
+            { "tracking_url",  fulfillment.trackingUrl },
+        });
 
-    connect(m_reply, &QNetworkReply::finished, m_reply, [this]()
-    {
-        if(!m_reply)
-            return;
-
-        const QByteArray json = m_reply->readAll();
-        qDebug() << "finished" << json;
-
-        QJsonParseError error = {};
-        QJsonDocument doc = QJsonDocument::fromJson(json, &error);
-        if (error.error != QJsonParseError::NoError) {
-            setErrorMsg(error.errorString());
-            return;
+        if (!queueMutation(fulfillment.orderId, rootObj)) {
+            errors << tr("#%1: Couldn't save the change.").arg(fulfillment.orderId);
+            continue;
         }
 
-        const QJsonObject root = doc.object();
+        changed << m_orders[fulfillment.orderId];
+    }
 
-        // update the order
-        Order order = parseJsonOrder(root);
-        m_sqlMgr->restore(order);
-        m_orders.insert(order.id, order);
-        emit orderUpdated(order);
+    // the queue has the changes already, the local properties didn't change
+    if (!changed.isEmpty())
+        emit ordersUpdated(changed);
 
-        // cleanup reply
-        m_reply->deleteLater();
-        m_reply = nullptr;
+    if (!errors.isEmpty())
+        QMessageBox::warning(nullptr, tr("Bad order"), errors.join("\n"));
 
-        // close the dialog
-        m_progressDlg->setValue(m_progressDlg->maximum());
-        if (m_progressDlg->isVisible())
-            m_progressDlg->hide();
-    });
+    sendMutations();
 }
 
 void OrderManager::setPackaging(const int orderId, const int packId)
@@ -170,7 +482,7 @@ void OrderManager::setPackaging(const int orderId, const int packId)
     if (packId == prevPackId)
         return;
 
-    order.packaging = packId;
+    order.setPackaging(packId);
 
     // increase old packaging stock
     if (prevPackId > 0)
@@ -185,29 +497,220 @@ void OrderManager::setPackaging(const int orderId, const int packId)
     emit orderUpdated(order);
 }
 
+void OrderManager::setNote(const int orderId, const QString &note)
+{
+    if (!m_orders.contains(orderId))
+        return;
+
+    Order &order = m_orders[orderId];
+    order.setNote(note);
+    if (!order.isDirty())
+        return;
+
+    m_sqlMgr->save(order);
+    order.clearDirty();
+
+    updateSearchIndex({ order });
+}
+
+void OrderManager::updateSearchIndex(const QList<Order> &orders)
+{
+    for (const Order &order : orders)
+        m_searchIndex.update(order);
+
+    emit searchIndexChanged();
+}
+
 void OrderManager::resetProgressDlg()
 {
+    m_errorShown = false;
+
     m_progressDlg->setValue(0);
     m_progressDlg->setMaximum(0);
     m_progressDlg->setLabelText(tr("Refreshing orders..."));
     m_progressDlg->setCancelButtonText(QString());
 }
 
-void OrderManager::fetch(const int offset, const int limit)
+bool OrderManager::queueMutation(const int orderId, const QJsonObject &changes)
 {
-    if (m_progressDlg->maximum() == 0)
-        m_progressDlg->setMaximum(limit);
+    // on disk first, so it survives the app being closed while the server is unreachable
+    const SqlManager::Mutation mutation = m_sqlMgr->addMutation(orderId, QJsonDocument(changes).toJson(QJsonDocument::Compact));
+    if (mutation.id < 0)
+        return false;
 
-    if (m_reply) {
-        qDebug() << "Trying to fetch while previous request still active!";
-        return;
+    m_mutations << mutation;
+
+    // show it right away, the server catches up later
+    Order &order = m_orders[orderId];
+    if (!m_serverOrders.contains(orderId))
+        m_serverOrders.insert(orderId, order);
+
+    applyMutation(order, mutation);
+
+    return true;
+}
+
+bool OrderManager::hasPendingMutations(const int orderId) const
+{
+    if (m_sendingMutations.contains(orderId))
+        return true;
+
+    for (const SqlManager::Mutation &mutation : m_mutations) {
+        if (mutation.orderId == orderId)
+            return true;
+    }
+
+    return false;
+}
+
+void OrderManager::applyPendingMutations(Order &order) const
+{
+    if (m_sendingMutations.contains(order.id))
+        applyMutation(order, m_sendingMutations[order.id]);
+
+    for (const SqlManager::Mutation &mutation : m_mutations) {
+        if (mutation.orderId == order.id)
+            applyMutation(order, mutation);
     }
+}
+
+void OrderManager::sendMutations()
+{
+    // while the server seems to be gone only one goes out, to see if it's back
+    const int maxActive = m_offline ? 1 : std::max(1, m_shared->updateConcurrency);
+
+    for (int i = 0; (i < m_mutations.size()) && (m_sendingMutations.size() < maxActive);) {
+        // changes to the same order have to reach the server in the order they were made
+        if (m_sendingMutations.contains(m_mutations[i].orderId)) {
+            ++i;
+            continue;
+        }
+
+        const SqlManager::Mutation mutation = m_mutations.takeAt(i);
+        m_sendingMutations.insert(mutation.orderId, mutation);
+
+        putOrder(mutation);
+    }
+
+    if (m_mutations.isEmpty())
+        m_replayTimer.stop();
+}
+
+void OrderManager::putOrder(const SqlManager::Mutation &mutation, const int attempt)
+{
+    QUrl url(ApiUrl + "/" + QString::number(mutation.orderId));
+
+    QNetworkRequest req(url);
+    req.setRawHeader("Content-Type", "application/json");
+    req.setRawHeader("Accept", "*/*");
+    req.setRawHeader("Authorization", QString("Bearer %1").arg(m_shared->apiKey).toUtf8());
+
+    // user changes don't wait for the page fetches
+    m_scheduler->enqueue(RequestScheduler::Priority::Mutation, [this, req, mutation, attempt]()
+    {
+        QNetworkReply *reply = m_nam->put(req, mutation.body);
+        m_updateReplies.insert(reply, mutation.orderId);
+
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 15, 0))
+        connect(reply, &QNetworkReply::errorOccurred, reply, [this, reply, mutation, attempt]()
+#else
+        connect(reply, qOverload<QNetworkReply::NetworkError>(&QNetworkReply::error), reply, [this, reply, mutation, attempt]()
+#endif
+        {
+            if (!m_updateReplies.contains(reply))
+                return;
+
+            // setting the same fields again is harmless, so it's safe to just send it again
+            const bool retrying = scheduleRetry(reply, attempt, false, [this, mutation, attempt]()
+            {
+                // given up on in the meantime
+                if (!m_sendingMutations.contains(mutation.orderId))
+                    return;
+
+                putOrder(mutation, attempt + 1);
+            });
+
+            if (retrying) {
+                m_updateReplies.remove(reply);
+                reply->disconnect(reply);
+                reply->deleteLater();
+            } else if (isRetryable(reply)) {
+                // still can't reach the server, the replay timer tries again later
+                deferMutation(reply);
+            } else if (reply->error() == QNetworkReply::AuthenticationRequiredError) {
+                setUpdateError(reply, tr("Authorization error, maybe double-check your API key!"));
+            } else {
+                setUpdateError(reply, reply->errorString());
+            }
+        });
+
+        connect(reply, &QNetworkReply::sslErrors, reply, [this, reply](const QList<QSslError> &errors)
+        {
+            if (!m_updateReplies.contains(reply))
+                return;
+
+            setUpdateError(reply, errors[0].errorString());
+        });
+
+        connect(reply, &QNetworkReply::finished, reply, [this, reply]()
+        {
+            if (!m_updateReplies.contains(reply))
+                return;
+
+            const QByteArray json = reply->readAll();
+            qDebug() << "finished" << json;
+
+            QJsonParseError error = {};
+            QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+            if (error.error != QJsonParseError::NoError) {
+                setUpdateError(reply, error.errorString());
+                return;
+            }
+
+            // the orders get merged together once the whole batch is done
+            m_fulfilledOrders << parseJsonOrder(doc.object());
+
+            // it's on the server now
+            const int id = m_updateReplies.take(reply);
+            m_sqlMgr->removeMutation(m_sendingMutations.take(id).id);
+            m_offline = false;
+
+            // cleanup reply
+            reply->deleteLater();
+
+            finishFulfillment(id, QString());
+        });
+
+        return reply;
+    });
+}
+
+void OrderManager::fetch(const int offset, const int limit, const int attempt)
+{
+    if (m_progressDlg->maximum() == 0)
+        m_progressDlg->setMaximum(limit);
 
     if (m_shared->apiKey.isEmpty()) {
         setErrorMsg(tr("You need to fill in your API key first. Go to Tools->Settings..., paste it there and try again."));
         return;
     }
 
+    // the request is built when it's sent, so it can use what the pages before it put in the cache
+    const int serial = m_fetchSerial;
+    m_queuedFetches += 1;
+    m_scheduler->enqueue(m_fetchPriority, [this, serial, offset, limit, attempt]() -> QNetworkReply*
+    {
+        // the refresh was aborted while this was waiting
+        if (serial != m_fetchSerial)
+            return nullptr;
+
+        m_queuedFetches -= 1;
+        return startFetch(offset, limit, attempt);
+    });
+}
+
+QNetworkReply *OrderManager::startFetch(const int offset, const int limit, const int attempt)
+{
     QUrlQuery query;
     query.addQueryItem("offset", QString::number(offset));
     query.addQueryItem("limit", QString::number(limit));
@@ -219,106 +722,618 @@ void OrderManager::fetch(const int offset, const int limit)
     req.setRawHeader("Accept", "*/*");
     req.setRawHeader("Authorization", QString("Bearer %1").arg(m_shared->apiKey).toUtf8());
 
-    m_reply = m_nam->get(req);
+    // older pages rarely change, let the server tell us if we can use what we got last time.
+    // Accept-Encoding is left to QNetworkAccessManager, it asks for gzip/deflate and decodes them for us
+    const QString cacheKey = url.toString();
+    const SqlManager::CachedPage cached = m_sqlMgr->cachedPage(cacheKey);
+    if (!cached.body.isEmpty()) {
+        if (!cached.etag.isEmpty())
+            req.setRawHeader("If-None-Match", cached.etag);
+
+        if (!cached.lastModified.isEmpty())
+            req.setRawHeader("If-Modified-Since", cached.lastModified);
+    }
+
+    QNetworkReply *reply = m_nam->get(req);
+    m_fetchReplies << reply;
+
+    FetchRequest &request = m_fetchRequests[reply];
+    request.timer.start();
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 15, 0))
-    connect(m_reply, &QNetworkReply::errorOccurred, m_reply, [this]()
+    connect(reply, &QNetworkReply::errorOccurred, reply, [this, reply, offset, limit, attempt]()
 #else
-    connect(m_reply, qOverload<QNetworkReply::NetworkError>(&QNetworkReply::error), m_reply, [this]()
+    connect(reply, qOverload<QNetworkReply::NetworkError>(&QNetworkReply::error), reply, [this, reply, offset, limit, attempt]()
 #endif
     {
-        if (m_reply->error() == QNetworkReply::AuthenticationRequiredError) {
+        if (!m_fetchReplies.contains(reply))
+            return;
+
+        // only this page failed, the rest of the refresh keeps going and the merged pages stay merged
+        const int serial = m_fetchSerial;
+        const bool retrying = scheduleRetry(reply, attempt, true, [this, serial, offset, limit, attempt]()
+        {
+            // the refresh was aborted in the meantime
+            if (serial != m_fetchSerial)
+                return;
+
+            m_pendingRetries -= 1;
+
+            fetch(offset, limit, attempt + 1);
+            scheduleFetches();
+        });
+
+        if (retrying) {
+            m_pendingRetries += 1;
+            m_fetchReplies.removeAll(reply);
+            m_fetchRequests.remove(reply);
+            reply->disconnect(reply);
+            reply->deleteLater();
+
+            // whatever arrived of this page is useless now
+            OrderPageParser *parser = m_parser;
+            QMetaObject::invokeMethod(parser, [parser, serial, offset]()
+            {
+                parser->discard(serial, offset);
+            }, Qt::QueuedConnection);
+        } else if (reply->error() == QNetworkReply::AuthenticationRequiredError) {
             setErrorMsg(tr("Authorization error, maybe double-check your API key!"));
         } else {
-            setErrorMsg(m_reply->errorString());
+            setErrorMsg(reply->errorString());
         }
     });
 
-    connect(m_reply, &QNetworkReply::sslErrors, m_reply, [this](const QList<QSslError> &errors)
+    connect(reply, &QNetworkReply::sslErrors, reply, [this, reply](const QList<QSslError> &errors)
     {
+        if (!m_fetchReplies.contains(reply))
+            return;
+
         setErrorMsg(errors[0].errorString());
     });
 
-    connect(m_reply, &QNetworkReply::finished, m_reply, [this]()
+    // orders get parsed on the parser thread while the rest of the page is still downloading
+    connect(reply, &QNetworkReply::readyRead, reply, [this, reply, offset]()
     {
-        if(!m_reply)
+        if (!m_fetchReplies.contains(reply) || isNotModified(reply))
             return;
 
-        const QByteArray json = m_reply->readAll();
+        const QByteArray data = reply->readAll();
 
-        QJsonParseError error = {};
-        QJsonDocument doc = QJsonDocument::fromJson(json, &error);
-        if (error.error != QJsonParseError::NoError) {
-            setErrorMsg(error.errorString());
+        FetchRequest &request = m_fetchRequests[reply];
+        request.bytes += data.size();
+
+        // keep a copy for the cache
+        if (isCacheable(reply))
+            request.body += data;
+
+        feedParser(offset, data);
+    });
+
+    connect(reply, &QNetworkReply::finished, reply, [this, reply, offset, limit, cacheKey, cached]()
+    {
+        if (!m_fetchReplies.contains(reply))
             return;
+
+        const FetchRequest request = m_fetchRequests.take(reply);
+
+        if (isNotModified(reply)) {
+            m_cacheHits += 1;
+            m_cacheBytesSaved += cached.body.size();
+
+            feedParser(offset, cached.body);
+        } else {
+            const QByteArray data = reply->readAll();
+            feedParser(offset, data);
+
+            m_cacheMisses += 1;
+
+            if (isCacheable(reply)) {
+                const SqlManager::CachedPage page{ reply->rawHeader("ETag"), reply->rawHeader("Last-Modified"), request.body + data };
+                m_sqlMgr->setCachedPageAsync(cacheKey, limit, page);
+            }
+
+            // only full pages that really came over the network tell us anything about the page size
+            if (limit == m_pageSize) {
+                m_sampleBytes += request.bytes + data.size();
+                m_sampleMsecs += request.timer.elapsed();
+                m_sampleOrders += limit;
+                m_samplePages += 1;
+            }
         }
 
-        const QJsonObject root = doc.object();
+        m_fetchReplies.removeAll(reply);
+        reply->deleteLater();
+
+        // processFetch() gets the finished page
+        const int serial = m_fetchSerial;
+        OrderPageParser *parser = m_parser;
+        m_parsingPages += 1;
+        QMetaObject::invokeMethod(parser, [parser, serial, offset, limit]()
+        {
+            parser->finish(serial, offset, limit);
+        }, Qt::QueuedConnection);
+    });
 
-        m_reply->deleteLater();
-        m_reply = nullptr;
+    return reply;
+}
+
+void OrderManager::feedParser(const int offset, const QByteArray &data)
+{
+    if (data.isEmpty())
+        return;
+
+    const int serial = m_fetchSerial;
+    OrderPageParser *parser = m_parser;
+    QMetaObject::invokeMethod(parser, [parser, serial, offset, data]()
+    {
+        parser->feed(serial, offset, data);
+    }, Qt::QueuedConnection);
+}
+
+void OrderManager::scheduleFetches()
+{
+    // in delta mode every page decides if we need the next one, so no point fetching ahead
+    const int maxActive = m_deltaSync ? 1 : std::max(1, m_shared->fetchConcurrency);
+
+    // the server asked us to slow down, the page waiting for a retry will call us again
+    if (m_rateLimitedUntil > QDateTime::currentDateTimeUtc())
+        return;
+
+    while ((m_fetchReplies.size() + m_queuedFetches + m_pendingRetries < maxActive) && (m_nextOffset < m_totalOrders)) {
+        const int size = std::min(m_pageSize, m_totalOrders - m_nextOffset);
+
+        fetch(m_nextOffset, size);
+
+        // fetch() can fail and abort the whole refresh
+        if (m_totalOrders < 0)
+            return;
+
+        m_nextOffset += size;
+    }
+}
+
+void OrderManager::processFetch(const OrderPage &page)
+{
+    // page from a refresh that was already aborted
+    if (page.serial != m_fetchSerial)
+        return;
 
-        processFetch(root);
+    m_parsingPages -= 1;
+    m_restoreMsecs += page.restoreMsecs;
+
+    // first page tells us how many orders there are in total
+    if (m_totalOrders < 0) {
+        m_totalOrders = page.totalCount;
+        m_progressDlg->setMaximum(std::max(m_totalOrders, 1));
+    }
+
+    // pages can arrive in any order, keep them until all the previous ones are merged
+    m_fetchedPages.insert(page.offset, page);
+
+    while (m_fetchedPages.contains(m_mergeOffset)) {
+        const OrderPage nextPage = m_fetchedPages.take(m_mergeOffset);
+        const int count = (int)(nextPage.orders.size() + nextPage.unchangedIds.size());
+
+        const QDateTime pageNewest = mergeOrders(nextPage);
+        if (page.serial != m_fetchSerial) // couldn't be stored, the refresh was aborted
+            return;
+
+        if (pageNewest > m_newestUpdate)
+            m_newestUpdate = pageNewest;
+
+        if ((count > 0) && (count < nextPage.limit) && (nextPage.offset + count < m_totalOrders)) {
+            // the server caps the page size, don't ask for more than that again and fill in the gap
+            m_pageSize = std::min(m_pageSize, count);
+            m_mergeOffset += count;
+
+            fetch(m_mergeOffset, nextPage.limit - count);
+            if (m_totalOrders < 0)
+                return;
+        } else {
+            m_mergeOffset += nextPage.limit;
+        }
+
+        m_progressDlg->setValue(std::min(m_progressDlg->value() + count, m_progressDlg->maximum()));
+
+        // nothing on this page changed since the last sync, so the older pages didn't either
+        if (m_deltaSync && !(pageNewest > m_syncMark))
+            m_totalOrders = std::min(m_totalOrders, m_mergeOffset);
+    }
+
+    if (m_mergeOffset < m_totalOrders) {
+        scheduleFetches();
+    } else if (m_fetchReplies.isEmpty() && (m_queuedFetches == 0) && (m_parsingPages == 0) && (m_pendingRetries == 0)) {
+        finishRefresh();
+    }
+}
+
+void OrderManager::finishRefresh()
+{
+    m_fetchedPages.clear();
+    m_totalOrders = -1;
+
+    adaptPageSize();
+
+    if (m_newestUpdate.isValid() && (m_newestUpdate != m_syncMark))
+        m_sqlMgr->setSyncValue(SyncMarkKey, m_newestUpdate.toUTC().toString(Qt::ISODateWithMs));
+
+    if (!m_deltaSync)
+        m_sqlMgr->setSyncValue(FullSyncKey, QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs));
+
+    writeSnapshot();
+
+    // we're done
+    m_progressDlg->setValue(m_progressDlg->maximum());
+    if (m_progressDlg->isVisible() && !m_errorShown)
+        m_progressDlg->hide();
+
+    // the server is reachable, send whatever piled up while it wasn't
+    if (m_offline) {
+        m_offline = false;
+        sendMutations();
+    }
+
+    emit refreshCompleted(m_newOrders, m_updatedOrders);
+}
+
+void OrderManager::writeSnapshot()
+{
+    // nothing was stored since the last one, or the last one is still being written and the next refresh catches up
+    const qint64 generation = m_sqlMgr->ordersGeneration();
+    if ((generation == m_snapshotGeneration) || m_snapshotWriting)
+        return;
+
+    // the snapshot mirrors the store, so it gets what the server said and not the changes still waiting to be sent
+    QList<Order> orders;
+    orders.reserve(m_orders.size());
+    for (auto it = m_orders.cbegin(); it != m_orders.cend(); ++it)
+        orders << m_serverOrders.value(it.key(), it.value());
+
+    // the copies share their data with ours, building and writing the file is what takes long
+    m_snapshotWriting = true;
+
+    auto *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, generation]()
+    {
+        if (watcher->result())
+            m_snapshotGeneration = generation;
+
+        m_snapshotWriting = false;
+        watcher->deleteLater();
     });
+
+    const QString fileName = m_sqlMgr->snapshotPath();
+    watcher->setFuture(QtConcurrent::run([fileName, orders, generation]()
+    {
+        return OrderSnapshot::write(fileName, orders, generation);
+    }));
 }
 
-void OrderManager::processFetch(const QJsonObject &root)
+void OrderManager::adaptPageSize()
 {
-    const int offset = root.value("offset").toInt();
-    const int totalOrders  = root.value("total_count").toInt();
+    if (m_samplePages == 0)
+        return;
 
-    const QJsonArray jsonOrders = root.value("orders").toArray();
-    const int count  = jsonOrders.size();
-    const int lastOrderNum = offset + count;
+    const double throughput = m_sampleOrders * 1000.0 / std::max<qint64>(m_sampleMsecs, 1);
 
-    for (const QJsonValue &val : jsonOrders) {
-        Order order = parseJsonOrder(val);
-        m_sqlMgr->restore(order);
+    // simple hill climbing: keep going while it gets faster, turn around when it gets slower
+    // and stay put when the difference is just noise, so the cached pages stay valid
+    if (m_lastThroughput > 0) {
+        if (throughput < m_lastThroughput * (1.0 - ThroughputTolerance)) {
+            m_pageSizeDirection = -m_pageSizeDirection;
+        } else if (throughput < m_lastThroughput * (1.0 + ThroughputTolerance)) {
+            m_lastThroughput = throughput;
+            return;
+        }
+    }
 
-        if (!contains(order.id)) {
-            m_orders.insert(order.id, order);
-            emit orderReceived(order);
+    m_lastThroughput = throughput;
 
-            m_newOrders += 1;
-        } else if (order != m_orders[order.id]) {
-            m_orders.insert(order.id, order);
-            emit orderUpdated(order);
+    const int minSize = std::min(m_shared->fetchSizeMin, m_shared->fetchSizeMax);
+    const int step = std::max(10, m_pageSize / 4);
+    const int pageSize = std::clamp(m_pageSize + m_pageSizeDirection * step, minSize, m_shared->fetchSizeMax);
+
+    if (pageSize == m_pageSize) {
+        // hit one of the bounds, try the other way next time
+        m_pageSizeDirection = -m_pageSizeDirection;
+        return;
+    }
+
+    m_pageSize = pageSize;
+    m_sqlMgr->setSyncValue(PageSizeKey, QString::number(m_pageSize));
 
-            m_updatedOrders += 1;
+    // the urls of every page just changed, the old ones would only take up space
+    m_sqlMgr->prunePageCacheAsync(m_pageSize);
+}
+
+bool OrderManager::scheduleRetry(const QNetworkReply *reply, const int attempt, const bool fetch, const std::function<void()> &retry)
+{
+    if ((attempt >= MaxRetries) || !isRetryable(reply))
+        return false;
+
+    const int delay = retryDelay(reply, attempt);
+    if (delay < 0)
+        return false;
+
+    // only a refresh holds back its fetches and has a progress dialog to update
+    if (fetch) {
+        if (isRateLimited(reply))
+            m_rateLimitedUntil = QDateTime::currentDateTimeUtc().addMSecs(delay);
+
+        if (!m_errorShown)
+            m_progressDlg->setLabelText(tr("Can't reach the server, trying again in %1 s (attempt %2 of %3)...").arg((delay + 999) / 1000).arg(attempt + 2).arg(MaxRetries + 1));
+    }
+
+    QTimer::singleShot(delay, this, [this, fetch, retry]()
+    {
+        if (fetch && !m_errorShown && isRefreshing())
+            m_progressDlg->setLabelText(tr("Refreshing orders..."));
+
+        retry();
+    });
+
+    return true;
+}
+
+void OrderManager::finishFulfillment(const int id, const QString &error)
+{
+    if (!error.isEmpty()) {
+        m_fulfillErrors << tr("#%1: %2").arg(id).arg(error);
+        revertMutation(id);
+    }
+
+    emit fulfillmentFinished(id, error);
+
+    sendMutations();
+
+    if (m_sendingMutations.isEmpty())
+        finishFulfillments();
+}
+
+void OrderManager::finishFulfillments()
+{
+    const QList<Order> orders = m_fulfilledOrders;
+    QStringList errors = m_fulfillErrors;
+    m_fulfilledOrders.clear();
+    m_fulfillErrors.clear();
+
+    if (orders.isEmpty() && errors.isEmpty())
+        return;
+
+    // the orders themselves went out fine, not being able to store them isn't counted as failed
+    const int failed = (int)errors.size();
+
+    // merge everything at once, one transaction instead of one per order
+    QList<Order> restored = orders;
+
+    // nothing is shown unless it's stored, the next refresh brings them in again
+    if (!m_sqlMgr->storeOrders(orders)) {
+        errors << tr("Couldn't store the orders in the database.");
+        restored.clear();
+    }
+
+    m_sqlMgr->restore(restored);
+
+    for (Order &order : restored) {
+        // changes made since this one went out still have to show
+        if (hasPendingMutations(order.id)) {
+            m_serverOrders.insert(order.id, order);
+            applyPendingMutations(order);
+        } else {
+            m_serverOrders.remove(order.id);
         }
+
+        m_orders.insert(order.id, order);
+    }
+
+    if (!restored.isEmpty())
+        emit ordersUpdated(restored);
+
+    emit fulfillmentsCompleted((int)orders.size(), failed);
+
+    if (!errors.isEmpty())
+        showError(errors.join("\n"));
+}
+
+void OrderManager::deferMutation(QNetworkReply *reply)
+{
+    const int id = m_updateReplies.take(reply);
+    const SqlManager::Mutation mutation = m_sendingMutations.take(id);
+
+    reply->disconnect(reply);
+    reply->abort();
+    reply->deleteLater();
+
+    // back where it was in the queue, so the order of the changes stays the same
+    int pos = 0;
+    while ((pos < m_mutations.size()) && (m_mutations[pos].id < mutation.id))
+        ++pos;
+
+    m_mutations.insert(pos, mutation);
+
+    m_offline = true;
+    m_replayTimer.start();
+
+    emit updatesQueued((int)m_mutations.size());
+
+    if (m_sendingMutations.isEmpty())
+        finishFulfillments();
+}
+
+void OrderManager::revertMutation(const int orderId)
+{
+    if (!contains(orderId) || !m_serverOrders.contains(orderId))
+        return;
+
+    // back to what the server has, plus whatever else is still waiting to be sent
+    Order &order = m_orders[orderId];
+    const Order server = m_serverOrders.value(orderId);
+    order.status = server.status;
+    order.fulfilledAt = server.fulfilledAt;
+    order.tracking = server.tracking;
+
+    applyPendingMutations(order);
+
+    if (!hasPendingMutations(orderId))
+        m_serverOrders.remove(orderId);
+
+    emit orderUpdated(order);
+}
+
+QDateTime OrderManager::mergeOrders(const OrderPage &page)
+{
+    QDateTime newest;
+    QList<Order> changed;
+    QList<Order> received;
+    QList<Order> updated;
+    QHash<int, Order> serverOrders;
+    QHash<int, quint64> hashes;
+
+    // exactly what we have already, only their dates matter for the delta sync
+    for (const int id : page.unchangedIds) {
+        const auto it = m_orders.constFind(id);
+        if ((it != m_orders.constEnd()) && (it->updatedAt > newest))
+            newest = it->updatedAt;
     }
+    m_unchangedOrders += (int)page.unchangedIds.size();
+
+    for (const Order &parsedOrder : page.orders) {
+        if (parsedOrder.updatedAt > newest)
+            newest = parsedOrder.updatedAt;
+
+        // the page could have waited for an earlier one while the note or packaging was edited
+        Order serverOrder = parsedOrder;
+        const auto local = m_orders.constFind(serverOrder.id);
+        if (local != m_orders.constEnd())
+            keepLocalProperties(serverOrder, local.value());
+
+        // our changes that didn't reach the server yet stay visible
+        Order order = serverOrder;
+        if (hasPendingMutations(order.id)) {
+            serverOrders.insert(order.id, serverOrder);
+            applyPendingMutations(order);
+        }
 
-    if (lastOrderNum < totalOrders) {
-        const int size = std::min(FetchSize, totalOrders - lastOrderNum);
+        if (!contains(order.id)) {
+            received << order;
+        } else if (order.updatedAt < m_orders[order.id].updatedAt) {
+            // the page was fetched before one of our own updates went through
+            continue;
+        } else if (order != m_orders[order.id]) {
+            updated << order;
+        }
 
-        fetch(lastOrderNum, size);
+        // stored even when nothing we show changed, what we show might be ahead of the store
+        // and once the hash is in, the parser won't give us this order again
+        changed << serverOrder;
+        hashes.insert(order.id, page.hashes.value(order.id));
+    }
 
-        m_progressDlg->setMaximum(totalOrders);
-        m_progressDlg->setValue(m_progressDlg->value() + count);
-    } else {
-        // we're done
-        m_progressDlg->setValue(m_progressDlg->maximum());
-        if (m_progressDlg->isVisible())
-            m_progressDlg->hide();
+    // the raw JSON of everything that changed on the server, even if we don't show the difference
+    QHash<int, QByteArray> payloads;
+    for (auto it = hashes.cbegin(); it != hashes.cend(); ++it) {
+        const auto payload = page.payloads.constFind(it.key());
+        if (payload != page.payloads.constEnd())
+            payloads.insert(it.key(), payload.value());
+    }
 
-        emit refreshCompleted(m_newOrders, m_updatedOrders);
+    // orders, payloads and hashes of the whole page in one transaction, nothing is shown unless it's stored
+    if (!m_sqlMgr->storeOrders(changed, payloads, hashes)) {
+        setErrorMsg(tr("Couldn't store the orders in the database."));
+        return QDateTime();
     }
+
+    setParserHashes(hashes);
+
+    for (auto it = serverOrders.cbegin(); it != serverOrders.cend(); ++it)
+        m_serverOrders.insert(it.key(), it.value());
+
+    for (const Order &order : received)
+        m_orders.insert(order.id, order);
+
+    for (const Order &order : updated)
+        m_orders.insert(order.id, order);
+
+    m_newOrders += (int)received.size();
+    m_updatedOrders += (int)updated.size();
+
+    // one announcement for the whole page, the local properties are the ones we had so there's nothing to save
+    if (!received.isEmpty())
+        emit ordersReceived(received);
+
+    if (!updated.isEmpty())
+        emit ordersUpdated(updated);
+
+    return newest;
+}
+
+void OrderManager::setParserHashes(const QHash<int, quint64> &hashes)
+{
+    if (hashes.isEmpty())
+        return;
+
+    OrderPageParser *parser = m_parser;
+    QMetaObject::invokeMethod(parser, [parser, hashes]()
+    {
+        parser->setOrderHashes(hashes);
+    }, Qt::QueuedConnection);
 }
 
 void OrderManager::setErrorMsg(const QString &error)
 {
-    m_progressDlg->setValue(m_progressDlg->maximum());
-    m_progressDlg->setLabelText(tr("Failed to finish request, reason:\n\"%1\"\n\nTry again, maybe wait some time, or check if the website is up,\notherwise complain on Discord I guess.").arg(error));
-    m_progressDlg->setCancelButtonText(tr("OK"));
-    m_progressDlg->show();
+    showError(error);
+
+    // abort the whole refresh, the finished pages were already merged
+    const bool wasRefreshing = isRefreshing();
+    const QList<QNetworkReply*> fetchReplies = m_fetchReplies;
+    m_fetchReplies.clear();
+    m_fetchedPages.clear();
+    m_fetchRequests.clear();
+    m_fetchSerial += 1;
+    m_parsingPages = 0;
+    m_pendingRetries = 0;
+    m_queuedFetches = 0;
+    m_rateLimitedUntil = QDateTime();
+    m_totalOrders = -1;
+
+    m_scheduler->clear();
+
+    // only our own handlers go, the scheduler still has to see the replies finish
+    for (QNetworkReply *reply : fetchReplies) {
+        reply->disconnect(reply);
+        reply->abort();
+        reply->deleteLater();
+    }
 
-    if (!m_reply) {
-        qDebug() << Q_FUNC_INFO << "called with m_reply == nullptr, highly sus";
+    if (!wasRefreshing) {
+        qDebug() << Q_FUNC_INFO << "called without an active request, highly sus";
         return;
     }
 
-    m_reply->deleteLater();
-    m_reply = nullptr;
-
     emit refreshFailed(error);
 }
+
+void OrderManager::setUpdateError(QNetworkReply *reply, const QString &error)
+{
+    // only this update failed, the refresh and the other updates carry on
+    const int id = m_updateReplies.take(reply);
+
+    // the server won't take it, no point keeping it around
+    m_sqlMgr->removeMutation(m_sendingMutations.take(id).id);
+
+    reply->disconnect(reply);
+    reply->abort();
+    reply->deleteLater();
+
+    finishFulfillment(id, error);
+}
+
+void OrderManager::showError(const QString &error)
+{
+    m_errorShown = true;
+
+    m_progressDlg->setValue(m_progressDlg->maximum());
+    m_progressDlg->setLabelText(tr("Failed to finish request, reason:\n\"%1\"\n\nTry again, maybe wait some time, or check if the website is up,\notherwise complain on Discord I guess.").arg(error));
+    m_progressDlg->setCancelButtonText(tr("OK"));
+    m_progressDlg->show();
+}
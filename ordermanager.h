@@ -1,16 +1,23 @@
 #pragma once
 
+#include "orderpageparser.h"
+#include "ordersearchindex.h"
+#include "requestscheduler.h"
+#include "sqlmanager.h"
 #include "structs.h"
 
+#include <QElapsedTimer>
 #include <QHash>
+#include <QMap>
+#include <QTimer>
 
 class QJsonObject;
 class QNetworkAccessManager;
 class QNetworkReply;
 class QProgressDialog;
+class QThread;
 
 struct SharedData;
-class SqlManager;
 
 class OrderManager : public QObject
 {
@@ -19,40 +26,144 @@ class OrderManager : public QObject
     public:
         static QString ApiUrl;
 
+    private:
+        struct FetchRequest
+        {
+            QElapsedTimer timer{};
+            qint64 bytes{};
+            QByteArray body{};
+        };
+
+        // whatever the startup load read off the GUI thread
+        struct StoredOrders
+        {
+            QList<Order> orders{};
+            QHash<int, quint64> hashes{};
+            bool fromSnapshot{};
+            qint64 generation{-1};
+            int restoreMsecs{};
+        };
+
     public:
         OrderManager(QNetworkAccessManager *nam, SharedData *shared, SqlManager *sqlMgr, QWidget *parent = nullptr);
         ~OrderManager() override;
 
-        void refresh(const bool hidden);
+        void loadStoredOrders();
+        void refresh(const bool hidden, const bool fullSync = false);
 
         bool contains(const int id) const;
 
         Order &order(const int id);
 
+        bool isRefreshing() const;
+
         QList<int> orderIds() const;
 
+        const OrderSearchIndex &searchIndex() const;
+
+        QStringList diagnostics() const;
+
         void markShipped(const int id, const QString &trackingNo = QString(), const QString &trackingUrl = QString());
+        void markShipped(const QList<Fulfillment> &fulfillments);
         void setPackaging(const int orderId, const int packId);
+        void setNote(const int orderId, const QString &note);
 
     private:
         void resetProgressDlg();
-        void fetch(const int offset, const int limit);
-        void processFetch(const QJsonObject &root);
+        void fetch(const int offset, const int limit, const int attempt = 0);
+        QNetworkReply *startFetch(const int offset, const int limit, const int attempt);
+        bool queueMutation(const int orderId, const QJsonObject &changes);
+        bool hasPendingMutations(const int orderId) const;
+        void applyPendingMutations(Order &order) const;
+        void sendMutations();
+        void putOrder(const SqlManager::Mutation &mutation, const int attempt = 0);
+        void deferMutation(QNetworkReply *reply);
+        void revertMutation(const int orderId);
+        void finishFulfillment(const int id, const QString &error);
+        void finishFulfillments();
+        bool scheduleRetry(const QNetworkReply *reply, const int attempt, const bool fetch, const std::function<void()> &retry);
+        void feedParser(const int offset, const QByteArray &data);
+        void adaptPageSize();
+        void scheduleFetches();
+        void processFetch(const OrderPage &page);
+        QDateTime mergeOrders(const OrderPage &page);
+        void finishLoadStoredOrders(const StoredOrders &stored);
+        void setParserHashes(const QHash<int, quint64> &hashes);
+        void updateSearchIndex(const QList<Order> &orders);
+        void finishRefresh();
+        void writeSnapshot();
         void setErrorMsg(const QString &error);
+        void setUpdateError(QNetworkReply *reply, const QString &error);
+        void showError(const QString &error);
 
     signals:
-        void orderReceived(const Order &order);
+        void ordersReceived(const QList<Order> &orders);
         void orderUpdated(const Order &order);
+        void ordersUpdated(const QList<Order> &orders);
         void refreshCompleted(const int newOrder, const int updatedOrders);
         void refreshFailed(const QString &error);
+        void fulfillmentFinished(const int orderId, const QString &error);
+        void fulfillmentsCompleted(const int shipped, const int failed);
+        void updatesQueued(const int count);
+        void searchIndexChanged();
+        void storedOrdersLoaded(const int count);
 
     private:
+        std::function<void()> m_afterLoad{};
+        qint64 m_cacheBytesSaved{};
+        int m_cacheHits{};
+        int m_cacheMisses{};
+        bool m_deltaSync{};
+        bool m_errorShown{};
+        QMap<int, OrderPage> m_fetchedPages{};
+        RequestScheduler::Priority m_fetchPriority{RequestScheduler::Priority::Interactive};
+        QHash<QNetworkReply*, FetchRequest> m_fetchRequests{};
+        QList<QNetworkReply*> m_fetchReplies{};
+        int m_fetchSerial{};
+        bool m_firstRefresh{true};
+        QStringList m_fulfillErrors{};
+        QList<Order> m_fulfilledOrders{};
+        double m_lastThroughput{};
+        QElapsedTimer m_loadTimer{};
+        bool m_loadingStored{};
+        int m_mergeOffset{};
+        QList<SqlManager::Mutation> m_mutations{};
         QNetworkAccessManager *m_nam{};
+        QDateTime m_newestUpdate{};
         int m_newOrders{};
+        int m_nextOffset{};
+        bool m_offline{};
+        int m_pageSize{};
+        int m_pageSizeDirection{1};
         QHash<int, Order> m_orders{};
+        OrderPageParser *m_parser{};
+        QThread *m_parserThread{};
+        int m_parsingPages{};
+        int m_pendingRetries{};
         QProgressDialog *m_progressDlg{};
-        QNetworkReply *m_reply{};
+        int m_queuedFetches{};
+        QDateTime m_rateLimitedUntil{};
+        QTimer m_replayTimer{};
+        qint64 m_restoreMsecs{};
+        qint64 m_sampleBytes{};
+        qint64 m_sampleMsecs{};
+        int m_sampleOrders{};
+        int m_samplePages{};
+        RequestScheduler *m_scheduler{};
+        OrderSearchIndex m_searchIndex{};
+        QHash<int, SqlManager::Mutation> m_sendingMutations{};
+        QHash<int, Order> m_serverOrders{};
         SharedData *m_shared{};
+        qint64 m_snapshotGeneration{-1};
+        bool m_snapshotLoaded{};
+        bool m_snapshotWriting{};
         SqlManager *m_sqlMgr{};
+        int m_storeLoadMsecs{};
+        int m_storeRestoreMsecs{};
+        int m_storedOrders{};
+        QDateTime m_syncMark{};
+        int m_totalOrders{-1};
+        int m_unchangedOrders{};
         int m_updatedOrders{};
+        QHash<QNetworkReply*, int> m_updateReplies{};
 };
@@ -0,0 +1,135 @@
+#include "orderpageparser.h"
+#include "sqlmanager.h"
+#include "utils.h"
+
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+
+OrderPageParser::OrderPageParser(SqlManager *sqlMgr)
+    : QObject{}
+    , m_sqlMgr{sqlMgr}
+{
+
+}
+
+OrderPageParser::~OrderPageParser()
+{
+    // we're deleted from the worker thread, take its connection with us
+    m_sqlMgr->closeThreadDatabase();
+}
+
+void OrderPageParser::feed(const int serial, const int offset, const QByteArray &data)
+{
+    setSerial(serial);
+
+    PageStream &stream = m_streams[offset];
+
+    // build every order as soon as it's complete, the raw JSON goes away right after
+    const QList<QByteArray> elements = stream.reader.feed(data);
+    for (const QByteArray &element : elements) {
+        // most orders don't change between refreshes, no need to parse and restore those again
+        const quint64 hash = fnv1a64(element.constData(), element.size());
+        const auto known = m_hashIds.constFind(hash);
+        if (known != m_hashIds.constEnd()) {
+            stream.unchangedIds << known.value();
+            continue;
+        }
+
+        QJsonParseError error = {};
+        const QJsonDocument doc = QJsonDocument::fromJson(element, &error);
+        if (error.error != QJsonParseError::NoError) {
+            stream.error = error.errorString();
+            continue;
+        }
+
+        const Order order = parseJsonOrder(doc.object());
+
+        stream.hashes.insert(order.id, hash);
+        stream.orders << order;
+
+        // compressing is slow enough to keep it off the main thread too
+        stream.payloads.insert(order.id, qCompress(element));
+    }
+}
+
+void OrderPageParser::finish(const int serial, const int offset, const int limit)
+{
+    setSerial(serial);
+
+    PageStream stream = m_streams.take(offset);
+
+    QString error = stream.error;
+    if (error.isEmpty() && stream.reader.hasError())
+        error = stream.reader.errorString();
+    else if (error.isEmpty() && !stream.reader.isFinished())
+        error = tr("Incomplete reply from the server");
+
+    if (!error.isEmpty()) {
+        emit parseFailed(serial, error);
+        return;
+    }
+
+    // the local properties of the whole page in one go, the manager has its own for the orders it already keeps
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<Order> unknown;
+    QList<int> unknownIdx;
+    for (int i = 0; i < stream.orders.size(); ++i) {
+        if (m_orderHashes.contains(stream.orders[i].id))
+            continue;
+
+        unknown << stream.orders[i];
+        unknownIdx << i;
+    }
+
+    m_sqlMgr->restore(unknown);
+    for (int i = 0; i < unknown.size(); ++i)
+        stream.orders[unknownIdx[i]] = unknown[i];
+
+    OrderPage page;
+    page.restoreMsecs = timer.elapsed();
+    page.serial = serial;
+    page.offset = offset;
+    page.limit = limit;
+    page.totalCount = stream.reader.member("total_count").toInt();
+    page.orders = stream.orders;
+    page.hashes = stream.hashes;
+    page.payloads = stream.payloads;
+    page.unchangedIds = stream.unchangedIds;
+
+    emit pageParsed(page);
+}
+
+void OrderPageParser::discard(const int serial, const int offset)
+{
+    setSerial(serial);
+
+    // the page is going to be requested again, start over with whatever comes next
+    m_streams.remove(offset);
+}
+
+void OrderPageParser::setOrderHashes(const QHash<int, quint64> &hashes)
+{
+    // only the manager knows which orders it really kept, so it's the one telling us
+    for (auto it = hashes.cbegin(); it != hashes.cend(); ++it) {
+        const auto old = m_orderHashes.constFind(it.key());
+        if ((old != m_orderHashes.constEnd()) && (m_hashIds.value(old.value()) == it.key()))
+            m_hashIds.remove(old.value());
+
+        m_orderHashes.insert(it.key(), it.value());
+        m_hashIds.insert(it.value(), it.key());
+    }
+}
+
+void OrderPageParser::setSerial(const int serial)
+{
+    if (serial == m_serial)
+        return;
+
+    // new refresh, whatever was left from the previous one won't be finished
+    m_streams.clear();
+    m_serial = serial;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "orderstreamparser.h"
+#include "structs.h"
+
+#include <QHash>
+#include <QObject>
+
+class SqlManager;
+
+struct OrderPage
+{
+    int serial{};
+    int offset{};
+    int limit{};
+    int totalCount{};
+    qint64 restoreMsecs{};
+    QList<Order> orders{};
+    QHash<int, quint64> hashes{};
+    QHash<int, QByteArray> payloads{}; // qCompress'd raw JSON
+    QList<int> unchangedIds{};
+};
+Q_DECLARE_METATYPE(OrderPage)
+
+// Lives in a worker thread, turns raw API replies into orders while they download and restores the new ones page by page.
+// Orders that are byte for byte the same as what the manager already has are only reported by id.
+class OrderPageParser : public QObject
+{
+    Q_OBJECT
+
+    private:
+        struct PageStream
+        {
+            OrderStreamParser reader{};
+            QList<Order> orders{};
+            QHash<int, quint64> hashes{};
+            QHash<int, QByteArray> payloads{};
+            QList<int> unchangedIds{};
+            QString error{};
+        };
+
+    public:
+        explicit OrderPageParser(SqlManager *sqlMgr);
+        ~OrderPageParser() override;
+
+        void feed(const int serial, const int offset, const QByteArray &data);
+        void finish(const int serial, const int offset, const int limit);
+        void discard(const int serial, const int offset);
+        void setOrderHashes(const QHash<int, quint64> &hashes);
+
+    signals:
+        void pageParsed(const OrderPage &page);
+        void parseFailed(const int serial, const QString &error);
+
+    private:
+        void setSerial(const int serial);
+
+    private:
+        QHash<quint64, int> m_hashIds{};
+        QHash<int, quint64> m_orderHashes{};
+        int m_serial{};
+        SqlManager *m_sqlMgr{};
+        QHash<int, PageStream> m_streams{};
+};
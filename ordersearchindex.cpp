@@ -0,0 +1,162 @@
+#include "ordersearchindex.h"
+
+#include <QStringList>
+
+#include <algorithm>
+#include <iterator>
+
+static quint64 trigramKey(const QChar *chars)
+{
+    return (quint64(chars[0].unicode()) << 32) | (quint64(chars[1].unicode()) << 16) | quint64(chars[2].unicode());
+}
+
+void OrderSearchIndex::update(const Order &order)
+{
+    const QString text = searchText(order);
+
+    const auto it = m_texts.constFind(order.id);
+    if (it != m_texts.constEnd()) {
+        if (it.value() == text)
+            return;
+
+        removePostings(order.id, it.value());
+    }
+
+    m_texts.insert(order.id, text);
+    addPostings(order.id, text);
+}
+
+void OrderSearchIndex::remove(const int id)
+{
+    const auto it = m_texts.constFind(id);
+    if (it == m_texts.constEnd())
+        return;
+
+    removePostings(id, it.value());
+    m_texts.remove(id);
+}
+
+void OrderSearchIndex::clear()
+{
+    m_postings.clear();
+    m_texts.clear();
+}
+
+QSet<int> OrderSearchIndex::search(const QString &text) const
+{
+    QSet<int> result;
+
+    const QString query = text.trimmed().toLower();
+    if (query.isEmpty())
+        return result;
+
+    // too short for a trigram, just go through everything
+    if (query.size() < 3) {
+        for (auto it = m_texts.cbegin(); it != m_texts.cend(); ++it) {
+            if (it.value().contains(query))
+                result.insert(it.key());
+        }
+
+        return result;
+    }
+
+    // start with the rarest trigram, every other one can only make the list shorter
+    QList<const QVector<int>*> lists;
+    for (const quint64 key : trigrams(query)) {
+        const auto it = m_postings.constFind(key);
+        if (it == m_postings.constEnd())
+            return result;
+
+        lists << &it.value();
+    }
+
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) { return a->size() < b->size(); });
+
+    QVector<int> candidates = *lists.first();
+    for (int i = 1; (i < lists.size()) && !candidates.isEmpty(); ++i) {
+        QVector<int> common;
+        std::set_intersection(candidates.cbegin(), candidates.cend(), lists[i]->cbegin(), lists[i]->cend(), std::back_inserter(common));
+        candidates = common;
+    }
+
+    // having all the trigrams doesn't mean they're next to each other
+    for (const int id : candidates) {
+        if (m_texts.value(id).contains(query))
+            result.insert(id);
+    }
+
+    return result;
+}
+
+QString OrderSearchIndex::searchText(const Order &order)
+{
+    QStringList fields;
+    fields << QString::number(order.id);
+
+    for (const Address *address : { &order.shipping.address, &order.billing.address }) {
+        fields << address->firstName + " " + address->lastName
+               << address->organization
+               << address->street
+               << address->streetExtension
+               << address->postalCode
+               << address->city
+               << address->state
+               << address->country;
+    }
+
+    fields << order.customerEmail
+           << order.customerPhone
+           << order.shipping.method
+           << order.statusString()
+           << order.tracking.code
+           << order.note;
+
+    for (const Item &item : order.items) {
+        fields << item.product.name << item.product.sku;
+
+        for (const ItemOption &option : item.options)
+            fields << option.name << option.choice << option.sku;
+    }
+
+    // trigrams across two fields contain the separator, so a query can't match them
+    fields.removeAll(QString());
+    return fields.join('\n').toLower();
+}
+
+QSet<quint64> OrderSearchIndex::trigrams(const QString &text)
+{
+    QSet<quint64> keys;
+    for (qsizetype i = 0; i + 2 < text.size(); ++i)
+        keys.insert(trigramKey(text.constData() + i));
+
+    return keys;
+}
+
+void OrderSearchIndex::addPostings(const int id, const QString &text)
+{
+    for (const quint64 key : trigrams(text)) {
+        QVector<int> &ids = m_postings[key];
+
+        // ids mostly arrive in order, so this is usually an append
+        const auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+        if ((pos == ids.end()) || (*pos != id))
+            ids.insert(pos, id);
+    }
+}
+
+void OrderSearchIndex::removePostings(const int id, const QString &text)
+{
+    for (const quint64 key : trigrams(text)) {
+        const auto it = m_postings.find(key);
+        if (it == m_postings.end())
+            continue;
+
+        QVector<int> &ids = it.value();
+        const auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+        if ((pos != ids.end()) && (*pos == id))
+            ids.erase(pos);
+
+        if (ids.isEmpty())
+            m_postings.erase(it);
+    }
+}
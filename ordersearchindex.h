@@ -0,0 +1,32 @@
+#pragma once
+
+#include "structs.h"
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+// In-memory trigram index over the searchable text of every order.
+// A search only looks at the orders that share all the trigrams of the query, so it costs
+// about as much as the number of matches, not the number of orders.
+class OrderSearchIndex
+{
+    public:
+        void update(const Order &order);
+        void remove(const int id);
+        void clear();
+
+        QSet<int> search(const QString &text) const;
+
+    private:
+        static QString searchText(const Order &order);
+        static QSet<quint64> trigrams(const QString &text);
+
+        void addPostings(const int id, const QString &text);
+        void removePostings(const int id, const QString &text);
+
+    private:
+        // sorted order ids for every trigram
+        QHash<quint64, QVector<int>> m_postings{};
+        QHash<int, QString> m_texts{};
+};
@@ -0,0 +1,537 @@
+#include "ordersnapshot.h"
+#include "utils.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QSaveFile>
+
+#include <cstring>
+#include <limits>
+
+// "LZOS", also tells us if the file was written on a machine with different endianness
+static const quint32 SnapshotMagic = 0x4c5a4f53;
+
+// bump when any of the records below change
+static const quint32 SnapshotVersion = 1;
+
+static const qint64 InvalidDate = std::numeric_limits<qint64>::min();
+
+// all the records are fixed-size, strings are indices into the string table, 0 is the empty string
+struct AddressRecord
+{
+    quint32 firstName;
+    quint32 lastName;
+    quint32 organization;
+    quint32 street;
+    quint32 streetExtension;
+    quint32 postalCode;
+    quint32 city;
+    quint32 state;
+    quint32 country;
+    quint32 countryCode;
+};
+
+struct OrderRecord
+{
+    qint64 createdAt;
+    qint64 updatedAt;
+    qint64 fulfilledAt;
+    qint64 fulfillUntil;
+
+    double subtotal;
+    double taxableAmount;
+    double total;
+    double payout;
+    double lectronzFee;
+    double paymentFee;
+    double taxRate;
+    double taxTotal;
+    double taxCollected;
+    double shippingCost;
+    double weightTotal;
+    double weightBase;
+
+    qint32 id;
+    qint32 storeId;
+
+    quint32 firstItem;
+    quint32 itemCount;
+    quint32 firstCode;
+    quint32 codeCount;
+
+    quint32 currency;
+    quint32 paymentProvider;
+    quint32 paymentReference;
+    quint32 status;
+    quint32 storeUrl;
+    quint32 customerLegalStatus;
+    quint32 customerEmail;
+    quint32 customerPhone;
+    quint32 customerNote;
+    quint32 taxNumber;
+    quint32 shippingMethod;
+    quint32 trackingCode;
+    quint32 trackingUrl;
+    quint32 weightUnit;
+
+    AddressRecord billingAddress;
+    AddressRecord shippingAddress;
+
+    quint8 useShippingAddress;
+    quint8 taxAppliesToShipping;
+    quint8 trackingRequired;
+    quint8 padding[5];
+};
+
+struct ItemRecord
+{
+    double price;
+    double discount;
+    double weight;
+
+    qint32 productId;
+    qint32 qty;
+
+    quint32 productName;
+    quint32 productSku;
+    quint32 productDescription;
+    quint32 firstOption;
+    quint32 optionCount;
+    quint32 padding;
+};
+
+struct OptionRecord
+{
+    double weight;
+
+    quint32 sku;
+    quint32 name;
+    quint32 choice;
+    quint32 padding;
+};
+
+struct StringEntry
+{
+    quint32 offset;
+    quint32 size;
+};
+
+// the layout is the file format, make sure the compiler doesn't add anything
+static_assert(sizeof(AddressRecord) == 40);
+static_assert(sizeof(OrderRecord) == 296);
+static_assert(sizeof(ItemRecord) == 56);
+static_assert(sizeof(OptionRecord) == 24);
+static_assert(sizeof(StringEntry) == 8);
+
+static qint64 dateToRecord(const QDateTime &date)
+{
+    return date.isValid() ? date.toMSecsSinceEpoch() : InvalidDate;
+}
+
+static QDateTime dateFromRecord(const qint64 msecs)
+{
+    return (msecs == InvalidDate) ? QDateTime() : QDateTime::fromMSecsSinceEpoch(msecs);
+}
+
+template<typename T>
+static void appendRecord(QByteArray &section, const T &record)
+{
+    section.append(reinterpret_cast<const char*>(&record), sizeof(T));
+}
+
+class StringTable
+{
+    public:
+        StringTable()
+        {
+            // index 0 is reserved for the empty string
+            m_entries << StringEntry{};
+        }
+
+        quint32 add(const QString &str)
+        {
+            if (str.isEmpty())
+                return 0;
+
+            const auto it = m_indices.constFind(str);
+            if (it != m_indices.constEnd())
+                return it.value();
+
+            const QByteArray utf8 = str.toUtf8();
+            const quint32 index = (quint32)m_entries.size();
+
+            m_entries << StringEntry{ (quint32)m_data.size(), (quint32)utf8.size() };
+            m_data += utf8;
+            m_indices.insert(str, index);
+
+            return index;
+        }
+
+        void addAddress(AddressRecord &rec, const Address &address)
+        {
+            rec.firstName       = add(address.firstName);
+            rec.lastName        = add(address.lastName);
+            rec.organization    = add(address.organization);
+            rec.street          = add(address.street);
+            rec.streetExtension = add(address.streetExtension);
+            rec.postalCode      = add(address.postalCode);
+            rec.city            = add(address.city);
+            rec.state           = add(address.state);
+            rec.country         = add(address.country);
+            rec.countryCode     = add(address.countryCode);
+        }
+
+        const QVector<StringEntry> &entries() const { return m_entries; }
+        const QByteArray &data() const { return m_data; }
+
+    private:
+        QByteArray m_data{};
+        QVector<StringEntry> m_entries{};
+        QHash<QString, quint32> m_indices{};
+};
+
+OrderSnapshot::~OrderSnapshot()
+{
+    close();
+}
+
+bool OrderSnapshot::write(const QString &fileName, const QList<Order> &orders, const qint64 generation)
+{
+    StringTable strings;
+    QByteArray orderSection;
+    QByteArray itemSection;
+    QByteArray optionSection;
+    QByteArray codeSection;
+    quint32 itemCount = 0;
+    quint32 optionCount = 0;
+    quint32 codeCount = 0;
+
+    orderSection.reserve(orders.size() * (qsizetype)sizeof(OrderRecord));
+
+    for (const Order &order : orders) {
+        OrderRecord rec{};
+        rec.createdAt            = dateToRecord(order.createdAt);
+        rec.updatedAt            = dateToRecord(order.updatedAt);
+        rec.fulfilledAt          = dateToRecord(order.fulfilledAt);
+        rec.fulfillUntil         = dateToRecord(order.fulfillUntil);
+        rec.subtotal             = order.subtotal;
+        rec.taxableAmount        = order.taxableAmount;
+        rec.total                = order.total;
+        rec.payout               = order.payout;
+        rec.lectronzFee          = order.lectronzFee;
+        rec.paymentFee           = order.paymentFee;
+        rec.taxRate              = order.tax.rate;
+        rec.taxTotal             = order.tax.total;
+        rec.taxCollected         = order.tax.collected;
+        rec.shippingCost         = order.shipping.cost;
+        rec.weightTotal          = order.weight.total;
+        rec.weightBase           = order.weight.base;
+        rec.id                   = order.id;
+        rec.storeId              = order.storeId;
+        rec.currency             = strings.add(order.currency);
+        rec.paymentProvider      = strings.add(order.payment.provider);
+        rec.paymentReference     = strings.add(order.payment.reference);
+        rec.status               = strings.add(order.status);
+        rec.storeUrl             = strings.add(order.storeUrl);
+        rec.customerLegalStatus  = strings.add(order.customerLegalStatus);
+        rec.customerEmail        = strings.add(order.customerEmail);
+        rec.customerPhone        = strings.add(order.customerPhone);
+        rec.customerNote         = strings.add(order.customerNote);
+        rec.taxNumber            = strings.add(order.tax.number);
+        rec.shippingMethod       = strings.add(order.shipping.method);
+        rec.trackingCode         = strings.add(order.tracking.code);
+        rec.trackingUrl          = strings.add(order.tracking.url);
+        rec.weightUnit           = strings.add(order.weight.unit);
+        rec.useShippingAddress   = order.billing.useShippingAddress;
+        rec.taxAppliesToShipping = order.tax.appliesToShipping;
+        rec.trackingRequired     = order.tracking.required;
+        strings.addAddress(rec.billingAddress, order.billing.address);
+        strings.addAddress(rec.shippingAddress, order.shipping.address);
+
+        rec.firstItem = itemCount;
+        rec.itemCount = (quint32)order.items.size();
+        for (const Item &item : order.items) {
+            ItemRecord itemRec{};
+            itemRec.price              = item.price;
+            itemRec.discount           = item.discount;
+            itemRec.weight             = item.weight;
+            itemRec.productId          = item.product.id;
+            itemRec.qty                = item.qty;
+            itemRec.productName        = strings.add(item.product.name);
+            itemRec.productSku         = strings.add(item.product.sku);
+            itemRec.productDescription = strings.add(item.product.description);
+            itemRec.firstOption        = optionCount;
+            itemRec.optionCount        = (quint32)item.options.size();
+
+            for (const ItemOption &option : item.options) {
+                OptionRecord optionRec{};
+                optionRec.weight = option.weight;
+                optionRec.sku    = strings.add(option.sku);
+                optionRec.name   = strings.add(option.name);
+                optionRec.choice = strings.add(option.choice);
+
+                appendRecord(optionSection, optionRec);
+            }
+
+            optionCount += itemRec.optionCount;
+            appendRecord(itemSection, itemRec);
+        }
+        itemCount += rec.itemCount;
+
+        rec.firstCode = codeCount;
+        rec.codeCount = (quint32)order.discountCodes.size();
+        for (const QString &code : order.discountCodes)
+            appendRecord(codeSection, strings.add(code));
+        codeCount += rec.codeCount;
+
+        appendRecord(orderSection, rec);
+    }
+
+    QByteArray body;
+    body.reserve(orderSection.size() + itemSection.size() + optionSection.size() + codeSection.size()
+                 + strings.entries().size() * (qsizetype)sizeof(StringEntry) + strings.data().size());
+    body += orderSection;
+    body += itemSection;
+    body += optionSection;
+    body += codeSection;
+    for (const StringEntry &entry : strings.entries())
+        appendRecord(body, entry);
+    body += strings.data();
+
+    Header header;
+    header.magic       = SnapshotMagic;
+    header.version     = SnapshotVersion;
+    header.generation  = generation;
+    header.checksum    = fnv1a64(body.constData(), body.size());
+    header.orderCount  = (quint32)orders.size();
+    header.itemCount   = itemCount;
+    header.optionCount = optionCount;
+    header.codeCount   = codeCount;
+    header.stringCount = (quint32)strings.entries().size();
+    header.stringBytes = (quint32)strings.data().size();
+
+    // written next to the old one and renamed over it, so there's never a half-written snapshot
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write order snapshot" << fileName << file.errorString();
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(body);
+
+    if (!file.commit()) {
+        qDebug() << "Failed to write order snapshot" << fileName << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool OrderSnapshot::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = m_file.size();
+    if (size < (qint64)sizeof(Header)) {
+        close();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    if (!m_data) {
+        close();
+        return false;
+    }
+
+    memcpy(&m_header, m_data, sizeof(Header));
+    if ((m_header.magic != SnapshotMagic) || (m_header.version != SnapshotVersion)) {
+        qDebug() << "Order snapshot" << fileName << "has an unknown format";
+        close();
+        return false;
+    }
+
+    // everything is counted in 64 bits, so a broken header can't overflow into something that looks right
+    m_itemsOffset       = (qint64)sizeof(Header) + (qint64)m_header.orderCount * (qint64)sizeof(OrderRecord);
+    m_optionsOffset     = m_itemsOffset + (qint64)m_header.itemCount * (qint64)sizeof(ItemRecord);
+    m_codesOffset       = m_optionsOffset + (qint64)m_header.optionCount * (qint64)sizeof(OptionRecord);
+    m_stringIndexOffset = m_codesOffset + (qint64)m_header.codeCount * (qint64)sizeof(quint32);
+    m_stringDataOffset  = m_stringIndexOffset + (qint64)m_header.stringCount * (qint64)sizeof(StringEntry);
+
+    if ((m_stringDataOffset + m_header.stringBytes) != size) {
+        qDebug() << "Order snapshot" << fileName << "is truncated";
+        close();
+        return false;
+    }
+
+    const char *body = reinterpret_cast<const char*>(m_data) + sizeof(Header);
+    if (fnv1a64(body, size - (qint64)sizeof(Header)) != m_header.checksum) {
+        qDebug() << "Order snapshot" << fileName << "is corrupted";
+        close();
+        return false;
+    }
+
+    m_decoded.resize((int)m_header.stringCount);
+    m_strings.resize((int)m_header.stringCount);
+
+    return true;
+}
+
+void OrderSnapshot::close()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+
+    m_data = nullptr;
+    m_file.close();
+    m_header = Header{};
+    m_decoded.clear();
+    m_strings.clear();
+}
+
+bool OrderSnapshot::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+qint64 OrderSnapshot::generation() const
+{
+    return m_header.generation;
+}
+
+int OrderSnapshot::count() const
+{
+    return (int)m_header.orderCount;
+}
+
+template<typename T>
+T OrderSnapshot::record(const qint64 sectionOffset, const quint32 index) const
+{
+    // copied out instead of cast, the sections don't have to be aligned for T
+    T rec;
+    memcpy(&rec, m_data + sectionOffset + (qint64)index * (qint64)sizeof(T), sizeof(T));
+    return rec;
+}
+
+Order OrderSnapshot::order(const int index) const
+{
+    Order order;
+    if (!isOpen() || (index < 0) || (index >= count()))
+        return order;
+
+    const OrderRecord rec = record<OrderRecord>(sizeof(Header), index);
+
+    order.id                         = rec.id;
+    order.storeId                    = rec.storeId;
+    order.createdAt                  = dateFromRecord(rec.createdAt);
+    order.updatedAt                  = dateFromRecord(rec.updatedAt);
+    order.fulfilledAt                = dateFromRecord(rec.fulfilledAt);
+    order.fulfillUntil               = dateFromRecord(rec.fulfillUntil);
+    order.subtotal                   = rec.subtotal;
+    order.taxableAmount              = rec.taxableAmount;
+    order.total                      = rec.total;
+    order.payout                     = rec.payout;
+    order.lectronzFee                = rec.lectronzFee;
+    order.paymentFee                 = rec.paymentFee;
+    order.currency                   = string(rec.currency);
+    order.payment.provider           = string(rec.paymentProvider);
+    order.payment.reference          = string(rec.paymentReference);
+    order.status                     = string(rec.status);
+    order.storeUrl                   = string(rec.storeUrl);
+    order.customerLegalStatus        = string(rec.customerLegalStatus);
+    order.customerEmail              = string(rec.customerEmail);
+    order.customerPhone              = string(rec.customerPhone);
+    order.customerNote               = string(rec.customerNote);
+    order.billing.address            = address(rec.billingAddress);
+    order.billing.useShippingAddress = rec.useShippingAddress;
+    order.tax.appliesToShipping      = rec.taxAppliesToShipping;
+    order.tax.rate                   = rec.taxRate;
+    order.tax.total                  = rec.taxTotal;
+    order.tax.collected              = rec.taxCollected;
+    order.tax.number                 = string(rec.taxNumber);
+    order.shipping.address           = address(rec.shippingAddress);
+    order.shipping.cost              = rec.shippingCost;
+    order.shipping.method            = string(rec.shippingMethod);
+    order.tracking.required          = rec.trackingRequired;
+    order.tracking.code              = string(rec.trackingCode);
+    order.tracking.url               = string(rec.trackingUrl);
+    order.weight.unit                = string(rec.weightUnit);
+    order.weight.total               = rec.weightTotal;
+    order.weight.base                = rec.weightBase;
+
+    if ((quint64)rec.firstItem + rec.itemCount <= m_header.itemCount) {
+        order.items.reserve((int)rec.itemCount);
+
+        for (quint32 i = 0; i < rec.itemCount; ++i) {
+            const ItemRecord itemRec = record<ItemRecord>(m_itemsOffset, rec.firstItem + i);
+
+            Item item;
+            item.price               = itemRec.price;
+            item.discount            = itemRec.discount;
+            item.weight              = itemRec.weight;
+            item.qty                 = itemRec.qty;
+            item.product.id          = itemRec.productId;
+            item.product.name        = string(itemRec.productName);
+            item.product.sku         = string(itemRec.productSku);
+            item.product.description = string(itemRec.productDescription);
+
+            if ((quint64)itemRec.firstOption + itemRec.optionCount <= m_header.optionCount) {
+                item.options.reserve((int)itemRec.optionCount);
+
+                for (quint32 j = 0; j < itemRec.optionCount; ++j) {
+                    const OptionRecord optionRec = record<OptionRecord>(m_optionsOffset, itemRec.firstOption + j);
+                    item.options << ItemOption{ string(optionRec.sku), string(optionRec.name), string(optionRec.choice), optionRec.weight };
+                }
+            }
+
+            order.items << item;
+        }
+    }
+
+    if ((quint64)rec.firstCode + rec.codeCount <= m_header.codeCount) {
+        for (quint32 i = 0; i < rec.codeCount; ++i)
+            order.discountCodes << string(record<quint32>(m_codesOffset, rec.firstCode + i));
+    }
+
+    return order;
+}
+
+QString OrderSnapshot::string(const quint32 index) const
+{
+    if ((index == 0) || (index >= m_header.stringCount))
+        return QString();
+
+    if (!m_decoded.testBit((int)index)) {
+        const StringEntry entry = record<StringEntry>(m_stringIndexOffset, index);
+        if ((quint64)entry.offset + entry.size <= m_header.stringBytes) {
+            const char *data = reinterpret_cast<const char*>(m_data + m_stringDataOffset + entry.offset);
+            m_strings[index] = QString::fromUtf8(data, (int)entry.size);
+        }
+
+        m_decoded.setBit((int)index);
+    }
+
+    // implicitly shared, every order using this string points at the same data
+    return m_strings[index];
+}
+
+Address OrderSnapshot::address(const AddressRecord &rec) const
+{
+    Address address;
+    address.firstName       = string(rec.firstName);
+    address.lastName        = string(rec.lastName);
+    address.organization    = string(rec.organization);
+    address.street          = string(rec.street);
+    address.streetExtension = string(rec.streetExtension);
+    address.postalCode      = string(rec.postalCode);
+    address.city            = string(rec.city);
+    address.state           = string(rec.state);
+    address.country         = string(rec.country);
+    address.countryCode     = string(rec.countryCode);
+
+    return address;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "structs.h"
+
+#include <QBitArray>
+#include <QFile>
+#include <QVector>
+
+struct AddressRecord;
+
+// A read-only copy of all the orders in a single file, written after every successful refresh.
+// The file is memory-mapped, orders are only built when asked for and every string is decoded once
+// and then shared between all the orders that use it.
+class OrderSnapshot
+{
+    private:
+        struct Header
+        {
+            quint32 magic{};
+            quint32 version{};
+            qint64 generation{};
+            quint64 checksum{};
+            quint32 orderCount{};
+            quint32 itemCount{};
+            quint32 optionCount{};
+            quint32 codeCount{};
+            quint32 stringCount{};
+            quint32 stringBytes{};
+        };
+
+    public:
+        OrderSnapshot() = default;
+        ~OrderSnapshot();
+
+        static bool write(const QString &fileName, const QList<Order> &orders, const qint64 generation);
+
+        bool open(const QString &fileName);
+        void close();
+
+        bool isOpen() const;
+        qint64 generation() const;
+        int count() const;
+
+        Order order(const int index) const;
+
+    private:
+        template<typename T>
+        T record(const qint64 sectionOffset, const quint32 index) const;
+
+        QString string(const quint32 index) const;
+        Address address(const AddressRecord &rec) const;
+
+    private:
+        const uchar *m_data{};
+        QFile m_file{};
+        Header m_header{};
+        qint64 m_itemsOffset{};
+        qint64 m_optionsOffset{};
+        qint64 m_codesOffset{};
+        qint64 m_stringIndexOffset{};
+        qint64 m_stringDataOffset{};
+        mutable QBitArray m_decoded{};
+        mutable QVector<QString> m_strings{};
+};
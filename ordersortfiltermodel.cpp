@@ -1,4 +1,5 @@
 #include "ordersortfiltermodel.h"
+#include "ordersearchindex.h"
 
 #include <QDateTime>
 
@@ -63,6 +64,13 @@ bool OrderSortFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &so
     if ((createdAt < m_startDate) || (createdAt > m_endDate))
         return false;
 
+    // search, the matches come from the index so there's no need to look at the cells
+    if (m_searchIndex && !m_searchText.isEmpty()) {
+        const QModelIndex idIndex = sourceModel()->index(sourceRow, 0, sourceParent);
+        if (!m_searchMatches.contains(idIndex.data().toInt()))
+            return false;
+    }
+
     return QSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
 }
 
@@ -80,3 +88,39 @@ void OrderSortFilterModel::setDateFilter(const QDateTime &startDate, const QDate
 
     invalidate();
 }
+
+void OrderSortFilterModel::setSearchIndex(const OrderSearchIndex *index)
+{
+    m_searchIndex = index;
+
+    updateSearchMatches();
+    invalidate();
+}
+
+void OrderSortFilterModel::setSearchText(const QString &text)
+{
+    m_searchText = text.trimmed();
+
+    updateSearchMatches();
+    invalidate();
+}
+
+void OrderSortFilterModel::refreshSearch()
+{
+    // the index changed, what matches might have too
+    if (!m_searchIndex || m_searchText.isEmpty())
+        return;
+
+    updateSearchMatches();
+    invalidateFilter();
+}
+
+void OrderSortFilterModel::updateSearchMatches()
+{
+    if (!m_searchIndex || m_searchText.isEmpty()) {
+        m_searchMatches.clear();
+        return;
+    }
+
+    m_searchMatches = m_searchIndex->search(m_searchText);
+}
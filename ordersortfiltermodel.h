@@ -1,8 +1,11 @@
 #pragma once
 
 #include <QDateTime>
+#include <QSet>
 #include <QSortFilterProxyModel>
 
+class OrderSearchIndex;
+
 class OrderSortFilterModel : public QSortFilterProxyModel
 {
     public:
@@ -21,8 +24,18 @@ class OrderSortFilterModel : public QSortFilterProxyModel
         void setColumnFilters(const int column, const QStringList &filters, const bool useData);
         void setDateFilter(const QDateTime &startDate, const QDateTime &endDate);
 
+        void setSearchIndex(const OrderSearchIndex *index);
+        void setSearchText(const QString &text);
+        void refreshSearch();
+
+    private:
+        void updateSearchMatches();
+
     private:
         QHash<int, ColumnFilter> m_columnFilters;
         QDateTime m_startDate;
         QDateTime m_endDate;
+        const OrderSearchIndex *m_searchIndex{};
+        QSet<int> m_searchMatches;
+        QString m_searchText;
 };
@@ -0,0 +1,230 @@
+#include "orderstreamparser.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QObject>
+
+QList<QByteArray> OrderStreamParser::feed(const QByteArray &data)
+{
+    if (m_finished || hasError())
+        return {};
+
+    m_buffer += data;
+
+    for (; m_pos < m_buffer.size(); ++m_pos) {
+        const char c = m_buffer.at(m_pos);
+
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_inString = false;
+
+                if (m_readingKey) {
+                    m_key = m_buffer.mid(m_keyStart + 1, m_pos - m_keyStart - 1);
+                    m_readingKey = false;
+                    m_keyStart = -1;
+                }
+            }
+
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+        {
+            m_inString = true;
+
+            if ((m_depth == 1) && m_expectKey) {
+                m_expectKey = false;
+                m_readingKey = true;
+                m_keyStart = m_pos;
+            } else {
+                beginValue(c);
+            }
+            break;
+        }
+
+        case '{':
+        case '[':
+        {
+            if (m_depth == 0) {
+                if (c != '{') {
+                    setError(QObject::tr("Expected an object at the start of the reply"));
+                    return {};
+                }
+
+                m_depth = 1;
+                m_expectKey = true;
+                break;
+            }
+
+            // the orders array itself is never kept, only its elements
+            if ((m_depth == 1) && (c == '[') && (m_key == "orders")) {
+                m_inOrders = true;
+                m_depth = 2;
+                break;
+            }
+
+            beginValue(c);
+            m_depth += 1;
+            break;
+        }
+
+        case '}':
+        case ']':
+        {
+            endScalar();
+
+            m_depth -= 1;
+            if (m_depth < 0) {
+                setError(QObject::tr("Unbalanced brackets in the reply"));
+                return {};
+            }
+
+            if (m_depth == 0) {
+                m_finished = true;
+                break;
+            }
+
+            if (m_inOrders && (m_depth == 1)) {
+                m_inOrders = false;
+                break;
+            }
+
+            endContainer();
+            break;
+        }
+
+        case ',':
+        {
+            endScalar();
+
+            if (m_depth == 1)
+                m_expectKey = true;
+            break;
+        }
+
+        case ':':
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+
+        default:
+            beginValue(c);
+            break;
+        }
+
+        if (m_finished)
+            break;
+    }
+
+    // drop everything we won't need to look at again
+    qsizetype keep = m_pos;
+    if (m_captureStart >= 0)
+        keep = m_captureStart;
+    else if (m_keyStart >= 0)
+        keep = m_keyStart;
+
+    if (keep > 0) {
+        m_buffer.remove(0, keep);
+        m_pos -= keep;
+
+        if (m_captureStart >= 0)
+            m_captureStart -= keep;
+
+        if (m_keyStart >= 0)
+            m_keyStart -= keep;
+    }
+
+    if (m_finished)
+        m_buffer.clear();
+
+    const QList<QByteArray> completed = m_completed;
+    m_completed.clear();
+
+    return completed;
+}
+
+bool OrderStreamParser::isFinished() const
+{
+    return m_finished;
+}
+
+bool OrderStreamParser::hasError() const
+{
+    return !m_error.isEmpty();
+}
+
+QString OrderStreamParser::errorString() const
+{
+    return m_error;
+}
+
+QJsonValue OrderStreamParser::member(const QString &key) const
+{
+    if (!m_members.contains(key))
+        return QJsonValue();
+
+    // wrap in an array, older Qt can't parse bare values
+    const QJsonArray array = QJsonDocument::fromJson("[" + m_members.value(key) + "]").array();
+    if (array.isEmpty())
+        return QJsonValue();
+
+    return array.at(0);
+}
+
+void OrderStreamParser::beginValue(const char c)
+{
+    if (m_captureStart >= 0)
+        return;
+
+    // we only care about root members and elements of the orders array
+    const bool rootMember = (m_depth == 1) && !m_inOrders;
+    const bool orderElement = (m_depth == 2) && m_inOrders;
+    if (!rootMember && !orderElement)
+        return;
+
+    m_captureStart = m_pos;
+    m_captureDepth = m_depth;
+    m_captureScalar = (c != '{') && (c != '[');
+}
+
+void OrderStreamParser::endScalar()
+{
+    if ((m_captureStart < 0) || !m_captureScalar || (m_depth != m_captureDepth))
+        return;
+
+    completeValue(m_pos);
+}
+
+void OrderStreamParser::endContainer()
+{
+    if ((m_captureStart < 0) || m_captureScalar || (m_depth != m_captureDepth))
+        return;
+
+    completeValue(m_pos + 1);
+}
+
+void OrderStreamParser::completeValue(const qsizetype end)
+{
+    const QByteArray value = m_buffer.mid(m_captureStart, end - m_captureStart).trimmed();
+
+    if (m_inOrders) {
+        m_completed << value;
+    } else {
+        m_members.insert(QString::fromUtf8(m_key), value);
+    }
+
+    m_captureStart = -1;
+}
+
+void OrderStreamParser::setError(const QString &error)
+{
+    m_error = error;
+    m_buffer.clear();
+}
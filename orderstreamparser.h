@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonValue>
+#include <QList>
+
+// Incremental splitter for order list replies, fed with chunks as they arrive.
+// Every element of the root "orders" array is handed out as raw JSON once its last byte
+// is in, the rest of the root members are kept so they can be read at the end.
+class OrderStreamParser
+{
+    public:
+        QList<QByteArray> feed(const QByteArray &data);
+
+        bool isFinished() const;
+        bool hasError() const;
+        QString errorString() const;
+
+        QJsonValue member(const QString &key) const;
+
+    private:
+        void beginValue(const char c);
+        void endScalar();
+        void endContainer();
+        void completeValue(const qsizetype end);
+        void setError(const QString &error);
+
+    private:
+        QByteArray m_buffer{};
+        qsizetype m_pos{};
+
+        int m_depth{};
+        bool m_inString{};
+        bool m_escape{};
+
+        bool m_expectKey{};
+        bool m_readingKey{};
+        qsizetype m_keyStart{-1};
+        QByteArray m_key{};
+
+        bool m_inOrders{};
+        qsizetype m_captureStart{-1};
+        int m_captureDepth{};
+        bool m_captureScalar{};
+
+        QList<QByteArray> m_completed{};
+        QHash<QString, QByteArray> m_members{};
+
+        bool m_finished{};
+        QString m_error{};
+};
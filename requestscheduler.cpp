@@ -0,0 +1,111 @@
+#include "requestscheduler.h"
+
+#include <QNetworkReply>
+
+RequestScheduler::RequestScheduler(QObject *parent)
+    : QObject{parent}
+{
+
+}
+
+int RequestScheduler::maxActive() const
+{
+    return m_maxActive;
+}
+
+void RequestScheduler::setMaxActive(const int maxActive)
+{
+    m_maxActive = std::max(1, maxActive);
+
+    startNext();
+}
+
+void RequestScheduler::enqueue(const Priority priority, const Sender &send)
+{
+    m_queue << Request{ priority, send };
+
+    startNext();
+}
+
+void RequestScheduler::promote(const Priority from, const Priority to)
+{
+    for (Request &request : m_queue) {
+        if (request.priority == from)
+            request.priority = to;
+    }
+
+    for (auto it = m_active.begin(); it != m_active.end(); ++it) {
+        if (it.value() == from)
+            it.value() = to;
+    }
+
+    startNext();
+}
+
+void RequestScheduler::clear()
+{
+    // mutations never wait in the queue, so this only drops fetches
+    m_queue.clear();
+}
+
+int RequestScheduler::activeCount() const
+{
+    return (int)m_active.size();
+}
+
+int RequestScheduler::queuedCount() const
+{
+    return (int)m_queue.size();
+}
+
+bool RequestScheduler::canStart(const Priority priority) const
+{
+    if (priority == Priority::Mutation)
+        return true;
+
+    // background work pauses until the user's changes are through
+    if ((priority == Priority::Background) && (m_activeMutations > 0))
+        return false;
+
+    return (m_active.size() - m_activeMutations) < m_maxActive;
+}
+
+void RequestScheduler::startNext()
+{
+    while (!m_queue.isEmpty()) {
+        // highest priority first, oldest first within the same priority
+        int next = 0;
+        for (int i = 1; i < m_queue.size(); ++i) {
+            if (m_queue[i].priority > m_queue[next].priority)
+                next = i;
+        }
+
+        if (!canStart(m_queue[next].priority))
+            return;
+
+        const Request request = m_queue.takeAt(next);
+
+        QNetworkReply *reply = request.send();
+        if (!reply)
+            continue;
+
+        m_active.insert(reply, request.priority);
+        if (request.priority == Priority::Mutation)
+            m_activeMutations += 1;
+
+        // connected after the sender's own handlers, so they see the reply finish first
+        connect(reply, &QNetworkReply::finished, this, [this, reply]() { release(reply); });
+        connect(reply, &QObject::destroyed, this, [this, reply]() { release(reply); });
+    }
+}
+
+void RequestScheduler::release(QNetworkReply *reply)
+{
+    if (!m_active.contains(reply))
+        return;
+
+    if (m_active.take(reply) == Priority::Mutation)
+        m_activeMutations -= 1;
+
+    startNext();
+}
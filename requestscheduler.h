@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+class QNetworkReply;
+
+// Decides which request goes out next. Changes made by the user go out right away,
+// everything else waits for a free slot, and background work also waits for the user's changes.
+class RequestScheduler : public QObject
+{
+    Q_OBJECT
+
+    public:
+        enum class Priority
+        {
+            Background = 0,
+            Interactive,
+            Mutation,
+        };
+
+        // sends the request when it's its turn, can return nullptr if there's nothing to send anymore
+        using Sender = std::function<QNetworkReply*()>;
+
+    private:
+        struct Request
+        {
+            Priority priority{};
+            Sender send{};
+        };
+
+    public:
+        explicit RequestScheduler(QObject *parent = nullptr);
+
+        int maxActive() const;
+        void setMaxActive(const int maxActive);
+
+        void enqueue(const Priority priority, const Sender &send);
+        void promote(const Priority from, const Priority to);
+        void clear();
+
+        int activeCount() const;
+        int queuedCount() const;
+
+    private:
+        bool canStart(const Priority priority) const;
+        void startNext();
+        void release(QNetworkReply *reply);
+
+    private:
+        QHash<QNetworkReply*, Priority> m_active{};
+        int m_activeMutations{};
+        int m_maxActive{1};
+        QList<Request> m_queue{};
+};
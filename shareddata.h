@@ -19,6 +19,13 @@ struct SharedData
     QString trackingUrl{};
     int csvSeparator{BulkExporterDialog::SepComma};
     bool groupOrderDetailWindows{};
+    int fetchConcurrency{4};
+    int fullSyncIntervalHours{24};
+    int fetchSizeMin{50};
+    int fetchSizeMax{500};
+    int updateConcurrency{4};
+    int backupIntervalHours{24};
+    int backupsKept{7};
 
     // Phone number sanitization
     bool phoneRemoveDashes{};
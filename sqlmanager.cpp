@@ -3,19 +3,153 @@
 
 #include <QDir>
 #include <QElapsedTimer>
+#include <QFile>
 #include <QFileInfo>
+#include <QMutexLocker>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
+#include <QTimer>
+#include <QtEndian>
+
+// other threads write while we read, so wait for the lock instead of failing right away
+static const QString ConnectOptions = "QSQLITE_BUSY_TIMEOUT=5000";
+
+// WAL lets the other connections read while one writes, and with it NORMAL only syncs on checkpoints
+static const QStringList ConnectionPragmas =
+{
+    "PRAGMA journal_mode = WAL;",
+    "PRAGMA synchronous = NORMAL;",
+    "PRAGMA cache_size = -8192;",
+};
+
+// a read-only handle can't switch the journal mode, the writers already did that for it
+static const QStringList ReadOnlyPragmas =
+{
+    "PRAGMA cache_size = -8192;",
+};
+
+// saves are collected for this long and then committed together by the writer thread
+static const int GroupCommitMs = 5;
+
+// how many read-only connections readAsync() gets to use at the same time
+static const int ReadConnections = 3;
+
+static const QString ThreadConnectionPrefix = "lectronizer-";
+
+// set on the threads of the read pool, they get read-only connections
+static thread_local bool readOnlyThread = false;
+
+// bump when the Order serialization changes, older records get skipped and fetched again
+static const quint8 OrderFormatVersion = 1;
+
+// the page cache keeps this many of the most recently fetched pages
+static const int PageCacheMaxPages = 200;
+
+// history deltas bigger than this are worth compressing, the usual status change isn't
+static const int HistoryCompressMin = 256;
+
+// bulk restores with more orders than this read the whole tables instead of listing the ids
+static const int RestoreByIdMax = 500;
+
+// backups are named after the database plus the time they were taken, so sorting by name sorts by age
+static const QString BackupTimeFormat = "yyyyMMdd-HHmmss";
+static const QString BackupSuffix = ".db";
+
+// goes up every time the stored orders change, the order snapshot remembers which one it was written at
+static const QString OrdersGenerationKey = "orders_generation";
+
+static QString threadConnectionName()
+{
+    return QString("%1%2%3").arg(ThreadConnectionPrefix)
+                            .arg(reinterpret_cast<quintptr>(QThread::currentThreadId()))
+                            .arg(readOnlyThread ? "-ro" : "");
+}
+
+// rows written before the data got compressed have no raw size
+static QByteArray storedData(const QVariant &data, const QVariant &rawSize)
+{
+    return rawSize.isNull() ? data.toByteArray() : qUncompress(data.toByteArray());
+}
+
+static bool decodeOrder(const QByteArray &data, Order &order)
+{
+    QDataStream stream(data);
+    stream.setVersion(StreamVersion);
+
+    quint8 version = 0;
+    stream >> version;
+    if (version != OrderFormatVersion)
+        return false;
+
+    stream >> order;
+    return (stream.status() == QDataStream::Ok);
+}
+
+// takes the write lock right away, a deferred transaction that reads first can't wait for the writer thread
+// to let go of it later and fails with SQLITE_BUSY_SNAPSHOT instead
+static bool beginWrite(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+    if (!query.exec("BEGIN IMMEDIATE;")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+static bool commitWrite(QSqlDatabase &db)
+{
+    if (db.commit())
+        return true;
+
+    qDebug() << "commit failed" << db.lastError().text();
+    db.rollback();
+    return false;
+}
+
+static void configureConnection(const QSqlDatabase &db)
+{
+    for (const QString &pragma : (readOnlyThread ? ReadOnlyPragmas : ConnectionPragmas)) {
+        QSqlQuery query(db);
+        if (!query.exec(pragma))
+            qDebug() << pragma << "failed" << query.lastError().text();
+    }
+}
 
 QList<SqlManager::TableInfo> SqlManager::TableInformation =
 {
     // table_versions must be first
     { "table_versions",        1, "(`table` TEXT NOT NULL, `version` INTEGER NOT NULL)"                                                                                 },
     { "order_properties",      1, "(`order_id` INTEGER NOT NULL UNIQUE, `note` TEXT, PRIMARY KEY(`order_id`))"                                                          },
-    { "order_packaging",       1, "(`order_id` INTEGER NOT NULL UNIQUE, `packaging_id` INTEGER NOT NULL, PRIMARY KEY(`order_id`))"                                      },
+    { "order_packaging",       2, "(`order_id` INTEGER NOT NULL UNIQUE, `packaging_id` INTEGER NOT NULL, PRIMARY KEY(`order_id`))",
+        {
+            {}, // 2: packaging_id index
+        },
+        {
+            "CREATE INDEX IF NOT EXISTS order_packaging_packaging_id ON order_packaging (`packaging_id`);",
+        }
+    },
     { "order_item_properties", 1, "(`order_id` INTEGER NOT NULL, `item_idx` INTEGER NOT NULL, `packaged` INTEGER, PRIMARY KEY(`order_id`,`item_idx`))"                  },
     { "packaging_types",       1, "(`id` INTEGER NOT NULL UNIQUE, `name` TEXT NOT NULL, `stock` INTEGER NOT NULL, `restock_url` TEXT, PRIMARY KEY(`id` AUTOINCREMENT))" },
+    { "sync_state",            1, "(`key` TEXT NOT NULL UNIQUE, `value` TEXT, PRIMARY KEY(`key`))"                                                                     },
+    { "page_cache",            1, "(`key` TEXT NOT NULL UNIQUE, `etag` TEXT, `last_modified` TEXT, `body` BLOB NOT NULL, `page_limit` INTEGER NOT NULL, `raw_size` INTEGER NOT NULL, `stored_at` TEXT NOT NULL, PRIMARY KEY(`key`))" },
+    { "orders",                2, "(`id` INTEGER NOT NULL UNIQUE, `updated_at` TEXT, `data` BLOB NOT NULL, `raw_size` INTEGER, PRIMARY KEY(`id`))",
+        {
+            { "ALTER TABLE orders ADD COLUMN `raw_size` INTEGER;" }, // 2: compressed data, rows without raw_size are still plain
+        }
+    },
+    { "mutation_queue",        1, "(`id` INTEGER NOT NULL UNIQUE, `order_id` INTEGER NOT NULL, `body` BLOB NOT NULL, `created_at` TEXT NOT NULL, PRIMARY KEY(`id` AUTOINCREMENT))" },
+    { "order_hashes",          1, "(`order_id` INTEGER NOT NULL UNIQUE, `hash` INTEGER NOT NULL, PRIMARY KEY(`order_id`))"                                             },
+    { "order_payloads",        1, "(`order_id` INTEGER NOT NULL UNIQUE, `raw_size` INTEGER NOT NULL, `payload` BLOB NOT NULL, PRIMARY KEY(`order_id`))"              },
+    { "order_history",         1, "(`id` INTEGER NOT NULL UNIQUE, `order_id` INTEGER NOT NULL, `changed_at` TEXT NOT NULL, `delta` BLOB NOT NULL, `raw_size` INTEGER, PRIMARY KEY(`id` AUTOINCREMENT))",
+        {},
+        {
+            "CREATE INDEX IF NOT EXISTS order_history_order_id ON order_history (`order_id`, `changed_at`);",
+        }
+    },
 };
 
 SqlManager::SqlManager(const QString &dbPath, QObject *parent)
@@ -25,26 +159,114 @@ SqlManager::SqlManager(const QString &dbPath, QObject *parent)
     // Make sure the path exists
     const QFileInfo pathInfo(dbPath);
     pathInfo.dir().mkpath(".");
+
+    // the threads keep their connections, so they're not allowed to expire
+    m_dbPool.setMaxThreadCount(1);
+    m_dbPool.setExpiryTimeout(-1);
+    m_readPool.setMaxThreadCount(ReadConnections);
+    m_readPool.setExpiryTimeout(-1);
 }
 
 SqlManager::~SqlManager()
 {
+    // queries still running need their connections
+    m_readPool.waitForDone();
+    m_dbPool.waitForDone();
+
+    if (m_writerThread) {
+        // whatever is still queued goes to disk before we're gone
+        QMetaObject::invokeMethod(m_writer, [this]()
+        {
+            m_commitTimer->stop();
+            commitPending();
+            closeThreadDatabase();
+        }, Qt::BlockingQueuedConnection);
+
+        m_writerThread->quit();
+        m_writerThread->wait();
+
+        delete m_writer;
+    }
+
+    // the statements have to go before their connections do
+    for (auto it = m_preparedQueries.cbegin(); it != m_preparedQueries.cend(); ++it)
+        qDeleteAll(it.value());
+
+    m_preparedQueries.clear();
 
+    // pool threads don't get to close their own connections, they're idle now so it's safe to do it here
+    for (const QString &name : QSqlDatabase::connectionNames()) {
+        if (name.startsWith(ThreadConnectionPrefix))
+            QSqlDatabase::removeDatabase(name);
+    }
 }
 
 QPair<bool, QString> SqlManager::init()
 {
     QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
     db.setDatabaseName(m_dbPath);
+    db.setConnectOptions(ConnectOptions);
     if (!db.open())
         return qMakePair(false, db.lastError().text());
 
-    return processTables();
+    configureConnection(db);
+
+    const QPair<bool, QString> res = processTables();
+    if (!res.first)
+        return res;
+
+    // local property saves are written on their own thread, so the UI doesn't wait for the disk
+    m_writerThread = new QThread(this);
+    m_writer = new QObject();
+    m_commitTimer = new QTimer(m_writer);
+    m_commitTimer->setSingleShot(true);
+    m_commitTimer->setInterval(GroupCommitMs);
+    connect(m_commitTimer, &QTimer::timeout, m_writer, [this]() { commitPending(); });
+    m_writer->moveToThread(m_writerThread);
+    m_writerThread->start();
+
+    return res;
+}
+
+QSqlDatabase SqlManager::database() const
+{
+    if (QThread::currentThread() == thread())
+        return QSqlDatabase::database();
+
+    // connections can't be shared between threads, so every other thread gets its own
+    const QString name = threadConnectionName();
+    if (QSqlDatabase::contains(name))
+        return QSqlDatabase::database(name);
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(m_dbPath);
+    db.setConnectOptions(readOnlyThread ? (ConnectOptions + ";QSQLITE_OPEN_READONLY") : ConnectOptions);
+    if (!db.open())
+        qDebug() << "Failed to open database connection" << name << db.lastError().text();
+    else
+        configureConnection(db);
+
+    return db;
+}
+
+void SqlManager::closeThreadDatabase()
+{
+    const QString name = threadConnectionName();
+    if (!QSqlDatabase::contains(name))
+        return;
+
+    {
+        QMutexLocker locker(&m_queryMutex);
+        qDeleteAll(m_preparedQueries.take(name));
+    }
+
+    QSqlDatabase::database(name, false).close();
+    QSqlDatabase::removeDatabase(name);
 }
 
 int SqlManager::tableVersion(const QString &tableName)
 {
-    QSqlQuery query;
+    QSqlQuery query(database());
     query.prepare("SELECT version FROM table_versions WHERE `table` = :table;");
     query.bindValue(":table", tableName);
     if (!query.exec() || !query.next()) {
@@ -57,7 +279,17 @@ int SqlManager::tableVersion(const QString &tableName)
 
 QPair<bool, QString> SqlManager::setTableVersion(const QString &tableName, const int version)
 {
-    QSqlQuery query;
+    QSqlQuery query(database());
+    query.prepare("UPDATE table_versions SET `version` = :version WHERE `table` = :table;");
+    query.bindValue(":table", tableName);
+    query.bindValue(":version", version);
+
+    if (!query.exec())
+        return qMakePair(false, query.lastQuery() + " failed " + query.lastError().text());
+
+    if (query.numRowsAffected() > 0)
+        return qMakePair(true, QString{});
+
     query.prepare("INSERT INTO table_versions (`table`, `version`) VALUES (:table, :version);");
     query.bindValue(":table", tableName);
     query.bindValue(":version", version);
@@ -68,99 +300,803 @@ QPair<bool, QString> SqlManager::setTableVersion(const QString &tableName, const
     return qMakePair(true, QString{});
 }
 
-void SqlManager::restore(Order &order)
+QSqlQuery &SqlManager::preparedQuery(const QString &sql) const
 {
-    QSqlQuery query;
+    // every connection keeps its own statements, preparing the same SQL over and over isn't free
+    const QSqlDatabase db = database();
 
-    // packaging
-    query.prepare("SELECT * FROM order_packaging WHERE order_id = :order_id;");
-    query.bindValue(":order_id", order.id);
+    QMutexLocker locker(&m_queryMutex);
+    QHash<QString, QSqlQuery*> &queries = m_preparedQueries[db.connectionName()];
+
+    QSqlQuery *query = queries.value(sql);
+    if (!query) {
+        query = new QSqlQuery(db);
+        if (!query->prepare(sql))
+            qDebug() << sql << "prepare failed" << query->lastError().text();
+
+        queries.insert(sql, query);
+    }
+
+    return *query;
+}
+
+QString SqlManager::syncValue(const QString &key) const
+{
+    QSqlQuery &query = preparedQuery("SELECT value FROM sync_state WHERE `key` = :key;");
+    query.bindValue(":key", key);
     if (!query.exec()) {
         qDebug() << query.lastQuery() << "failed" << query.lastError().text();
-        return;
+        return QString();
+    }
+
+    // cached statements have to be reset, or they keep the read open
+    const QString value = query.next() ? query.value(0).toString() : QString();
+    query.finish();
+
+    return value;
+}
+
+bool SqlManager::setSyncValue(const QString &key, const QString &value)
+{
+    QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO sync_state (`key`, `value`) VALUES (:key, :value);");
+    query.bindValue(":key", key);
+    query.bindValue(":value", value);
+
+    if (!query.exec()) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return false;
     }
 
-    if (query.next()) {
-        order.packaging = query.value("packaging_id").toInt();
+    return true;
+}
+
+SqlManager::CachedPage SqlManager::cachedPage(const QString &key) const
+{
+    QSqlQuery &query = preparedQuery("SELECT etag, last_modified, body FROM page_cache WHERE `key` = :key;");
+    query.bindValue(":key", key);
+    if (!query.exec()) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return CachedPage{};
     }
 
-    // order properties
-    query.prepare("SELECT * FROM order_properties WHERE order_id = :order_id;");
-    query.bindValue(":order_id", order.id);
+    CachedPage page;
+    if (query.next())
+        page = CachedPage{ query.value(0).toByteArray(), query.value(1).toByteArray(), qUncompress(query.value(2).toByteArray()) };
+
+    query.finish();
+
+    return page;
+}
+
+bool SqlManager::setCachedPage(const QString &key, const int limit, const CachedPage &page)
+{
+    QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO page_cache (`key`, `etag`, `last_modified`, `body`, `page_limit`, `raw_size`, `stored_at`) "
+                                     "VALUES (:key, :etag, :last_modified, :body, :page_limit, :raw_size, :stored_at);");
+    query.bindValue(":key", key);
+    query.bindValue(":etag", QString::fromLatin1(page.etag));
+    query.bindValue(":last_modified", QString::fromLatin1(page.lastModified));
+    query.bindValue(":body", qCompress(page.body));
+    query.bindValue(":page_limit", limit);
+    query.bindValue(":raw_size", page.body.size());
+    query.bindValue(":stored_at", QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs));
+
     if (!query.exec()) {
         qDebug() << query.lastQuery() << "failed" << query.lastError().text();
-        return;
+        return false;
+    }
+
+    // only the newest pages are worth keeping around
+    QSqlQuery &trim = preparedQuery("DELETE FROM page_cache WHERE `key` NOT IN (SELECT `key` FROM page_cache ORDER BY stored_at DESC LIMIT :max);");
+    trim.bindValue(":max", PageCacheMaxPages);
+
+    if (!trim.exec()) {
+        qDebug() << trim.lastQuery() << "failed" << trim.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+bool SqlManager::prunePageCache(const int limit)
+{
+    // pages of any other size won't be asked for again
+    QSqlQuery &query = preparedQuery("DELETE FROM page_cache WHERE page_limit != :page_limit;");
+    query.bindValue(":page_limit", limit);
+
+    if (!query.exec()) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+QList<SqlManager::Mutation> SqlManager::mutations() const
+{
+    QList<Mutation> mutations;
+
+    QSqlQuery query(database());
+    if (!query.exec("SELECT * FROM mutation_queue ORDER BY id;")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return mutations;
     }
 
     while (query.next()) {
-        order.note = query.value("note").toString();
+        Mutation mutation;
+        mutation.id = query.value("id").toInt();
+        mutation.orderId = query.value("order_id").toInt();
+        mutation.body = query.value("body").toByteArray();
+        mutation.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODateWithMs);
+
+        mutations << mutation;
     }
 
-    // order item properties
-    query.prepare("SELECT * FROM order_item_properties WHERE order_id = :order_id;");
-    query.bindValue(":order_id", order.id);
+    return mutations;
+}
+
+SqlManager::Mutation SqlManager::addMutation(const int orderId, const QByteArray &body)
+{
+    Mutation mutation;
+    mutation.id = -1;
+    mutation.orderId = orderId;
+    mutation.body = body;
+    mutation.createdAt = QDateTime::currentDateTimeUtc();
+
+    QSqlQuery query(database());
+    query.prepare("INSERT INTO mutation_queue (`order_id`, `body`, `created_at`) VALUES (:order_id, :body, :created_at);");
+    query.bindValue(":order_id", orderId);
+    query.bindValue(":body", body);
+    query.bindValue(":created_at", mutation.createdAt.toString(Qt::ISODateWithMs));
+
     if (!query.exec()) {
         qDebug() << query.lastQuery() << "failed" << query.lastError().text();
-        return;
+        return mutation;
+    }
+
+    mutation.id = query.lastInsertId().toInt();
+
+    return mutation;
+}
+
+bool SqlManager::removeMutation(const int id)
+{
+    QSqlQuery query(database());
+    query.prepare("DELETE FROM mutation_queue WHERE id = :id;");
+    query.bindValue(":id", id);
+
+    if (!query.exec()) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+QList<Order> SqlManager::storedOrders() const
+{
+    QList<Order> orders;
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT data, raw_size FROM orders;")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return orders;
     }
 
     while (query.next()) {
-        const int itemIdx = query.value("item_idx").toInt();
-        Item &item = order.items[itemIdx];
+        Order order;
+        if (!decodeOrder(storedData(query.value(0), query.value(1)), order))
+            continue;
 
-        item.packaged = query.value("packaged").toBool();
+        orders << order;
     }
+
+    return orders;
 }
 
-void SqlManager::save(const Order &order)
+bool SqlManager::storeOrders(const QList<Order> &orders, const QHash<int, QByteArray> &payloads, const QHash<int, quint64> &hashes)
 {
-    // order packaging
+    if (orders.isEmpty() && payloads.isEmpty() && hashes.isEmpty())
+        return true;
+
+    // one transaction for the whole batch, a hash without its order would hide the change next time
+    QSqlDatabase db = database();
+    if (!beginWrite(db))
+        return false;
+
+    QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO orders (`id`, `updated_at`, `data`, `raw_size`) VALUES (:id, :updated_at, :data, :raw_size);");
+
+    for (const Order &order : orders) {
+        if (!storeHistory(order)) {
+            db.rollback();
+            return false;
+        }
+
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(StreamVersion);
+        stream << OrderFormatVersion << order;
+
+        query.bindValue(":id", order.id);
+        query.bindValue(":updated_at", order.updatedAt.toUTC().toString(Qt::ISODateWithMs));
+        query.bindValue(":data", qCompress(data));
+        query.bindValue(":raw_size", data.size());
+
+        if (!query.exec()) {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+            db.rollback();
+            return false;
+        }
+    }
+
+    if (!writeOrderPayloads(payloads) || !writeOrderHashes(hashes)) {
+        db.rollback();
+        return false;
+    }
+
+    if (!orders.isEmpty() && !setSyncValue(OrdersGenerationKey, QString::number(ordersGeneration() + 1))) {
+        db.rollback();
+        return false;
+    }
+
+    return commitWrite(db);
+}
+
+Order SqlManager::orderAt(const int orderId, const QDateTime &time) const
+{
+    Order order;
+    if (!historyOrder(orderId, time, order))
+        return Order{};
+
+    return order;
+}
+
+bool SqlManager::historyOrder(const int orderId, const QDateTime &time, Order &order) const
+{
+    QSqlQuery &query = time.isValid()
+            ? preparedQuery("SELECT delta, raw_size FROM order_history WHERE order_id = :order_id AND changed_at <= :time ORDER BY id;")
+            : preparedQuery("SELECT delta, raw_size FROM order_history WHERE order_id = :order_id ORDER BY id;");
+    query.bindValue(":order_id", orderId);
+    if (time.isValid())
+        query.bindValue(":time", time.toUTC().toString(Qt::ISODateWithMs));
+
+    if (!query.exec()) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return false;
+    }
+
+    // the first one is the whole order, every one after that only what changed
+    bool found = false;
+    bool ok = true;
+    while (query.next()) {
+        ok = ok && applyOrderDelta(order, storedData(query.value(0), query.value(1)));
+        found = true;
+    }
+
+    query.finish();
+
+    order.id = orderId;
+    return found && ok;
+}
+
+bool SqlManager::storeHistory(const Order &order)
+{
+    // what we had before this version, straight from the store
+    Order previous;
+    bool hasPrevious = false;
     {
-        QSqlQuery query;
-        if (order.packaging > -1) {
-            query.prepare("INSERT OR REPLACE INTO order_packaging (`order_id`, `packaging_id`) VALUES (:order_id, :packaging_id);");
-            query.bindValue(":packaging_id", order.packaging);
-        } else {
-            query.prepare("DELETE FROM order_packaging WHERE order_id =:order_id;");
+        QSqlQuery &query = preparedQuery("SELECT data, raw_size FROM orders WHERE id = :id;");
+        query.bindValue(":id", order.id);
+
+        if (!query.exec()) {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+            return false;
         }
+
+        if (query.next())
+            hasPrevious = decodeOrder(storedData(query.value(0), query.value(1)), previous);
+
+        query.finish();
+    }
+
+    bool hasHistory = false;
+    {
+        QSqlQuery &query = preparedQuery("SELECT COUNT(*) FROM order_history WHERE order_id = :order_id;");
         query.bindValue(":order_id", order.id);
+
+        if (!query.exec() || !query.next()) {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+            return false;
+        }
+
+        hasHistory = (query.value(0).toInt() > 0);
+        query.finish();
+    }
+
+    // stored before there was any history, that version becomes the base
+    if (hasPrevious && !hasHistory) {
+        if (!addHistory(previous.id, previous.updatedAt, orderDelta(Order{}, previous)))
+            return false;
+
+        hasHistory = true;
+    }
+
+    // the stored copy is from an older format, the history still knows what it was
+    if (!hasPrevious && hasHistory)
+        hasPrevious = historyOrder(order.id, QDateTime(), previous);
+
+    const QByteArray delta = orderDelta(hasPrevious ? previous : Order{}, order);
+    if (delta.isEmpty())
+        return true;
+
+    return addHistory(order.id, order.updatedAt, delta);
+}
+
+bool SqlManager::addHistory(const int orderId, const QDateTime &changedAt, const QByteArray &delta)
+{
+    QSqlQuery &query = preparedQuery("INSERT INTO order_history (`order_id`, `changed_at`, `delta`, `raw_size`) VALUES (:order_id, :changed_at, :delta, :raw_size);");
+    query.bindValue(":order_id", orderId);
+    query.bindValue(":changed_at", changedAt.toUTC().toString(Qt::ISODateWithMs));
+
+    if (delta.size() > HistoryCompressMin) {
+        query.bindValue(":delta", qCompress(delta));
+        query.bindValue(":raw_size", delta.size());
+    } else {
+        query.bindValue(":delta", delta);
+        query.bindValue(":raw_size", QVariant());
+    }
+
+    if (!query.exec()) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+QHash<int, quint64> SqlManager::orderHashes() const
+{
+    QHash<int, quint64> hashes;
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT order_id, hash FROM order_hashes;")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return hashes;
+    }
+
+    while (query.next())
+        hashes.insert(query.value(0).toInt(), (quint64)query.value(1).toLongLong());
+
+    return hashes;
+}
+
+bool SqlManager::writeOrderHashes(const QHash<int, quint64> &hashes)
+{
+    QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO order_hashes (`order_id`, `hash`) VALUES (:order_id, :hash);");
+
+    for (auto it = hashes.cbegin(); it != hashes.cend(); ++it) {
+        // sqlite only has signed integers
+        query.bindValue(":order_id", it.key());
+        query.bindValue(":hash", (qint64)it.value());
+
         if (!query.exec()) {
             qDebug() << query.lastQuery() << "failed" << query.lastError().text();
-            return;
+            return false;
         }
     }
 
-    // order properties
-    QSqlQuery query;
-    query.prepare("INSERT OR REPLACE INTO order_properties (`order_id`, `note`) VALUES (:order_id, :note);");
-    query.bindValue(":order_id", order.id);
-    query.bindValue(":note", order.note);
+    return true;
+}
+
+QByteArray SqlManager::orderPayload(const int orderId) const
+{
+    // one row at a time, so reading a single order only inflates that order
+    QSqlQuery &query = preparedQuery("SELECT payload FROM order_payloads WHERE order_id = :order_id;");
+    query.bindValue(":order_id", orderId);
+
     if (!query.exec()) {
         qDebug() << query.lastQuery() << "failed" << query.lastError().text();
-        return;
+        return QByteArray();
     }
 
-    // order item properties
-    for (int i = 0; i < order.items.count(); ++i) {
-        const Item &item = order.items[i];
+    QByteArray payload;
+    if (query.next())
+        payload = qUncompress(query.value(0).toByteArray());
+
+    query.finish();
+    return payload;
+}
+
+bool SqlManager::writeOrderPayloads(const QHash<int, QByteArray> &payloads)
+{
+    QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO order_payloads (`order_id`, `raw_size`, `payload`) VALUES (:order_id, :raw_size, :payload);");
+
+    for (auto it = payloads.cbegin(); it != payloads.cend(); ++it) {
+        // qCompress puts the uncompressed size in front, big endian
+        const QByteArray &payload = it.value();
+        const quint32 rawSize = (payload.size() >= 4) ? qFromBigEndian<quint32>(payload.constData()) : 0;
+
+        query.bindValue(":order_id", it.key());
+        query.bindValue(":raw_size", rawSize);
+        query.bindValue(":payload", payload);
 
-        QSqlQuery query;
-        query.prepare("INSERT OR REPLACE INTO order_item_properties (`order_id`, `item_idx`, `packaged`) VALUES (:order_id, :item_idx, :packaged);");
-        query.bindValue(":order_id", order.id);
-        query.bindValue(":item_idx", i);
-        query.bindValue(":packaged", item.packaged);
         if (!query.exec()) {
             qDebug() << query.lastQuery() << "failed" << query.lastError().text();
-            return;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+qint64 SqlManager::ordersGeneration() const
+{
+    return syncValue(OrdersGenerationKey).toLongLong();
+}
+
+QString SqlManager::snapshotPath() const
+{
+    const QFileInfo dbInfo(m_dbPath);
+    return dbInfo.dir().filePath(dbInfo.completeBaseName() + ".snapshot");
+}
+
+QString SqlManager::backupDir() const
+{
+    const QFileInfo dbInfo(m_dbPath);
+    return dbInfo.dir().filePath("backups");
+}
+
+QDateTime SqlManager::lastBackupTime() const
+{
+    const QFileInfo dbInfo(m_dbPath);
+    const QDir dir(backupDir());
+
+    const QStringList backups = dir.entryList({ dbInfo.completeBaseName() + "-*" + BackupSuffix }, QDir::Files, QDir::Name | QDir::Reversed);
+    if (backups.isEmpty())
+        return QDateTime();
+
+    return QFileInfo(dir.filePath(backups.first())).lastModified();
+}
+
+SqlManager::Backup SqlManager::backup(const int keep)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const QFileInfo dbInfo(m_dbPath);
+    QDir dir(backupDir());
+    dir.mkpath(".");
+
+    Backup result;
+    result.fileName = dir.filePath(QString("%1-%2%3").arg(dbInfo.completeBaseName(), QDateTime::currentDateTime().toString(BackupTimeFormat), BackupSuffix));
+
+    // written next to the real name and only renamed once it checks out, so a backup is never half there
+    const QString partName = result.fileName + ".part";
+    QFile::remove(partName);
+
+    const auto finish = [&](const QString &error)
+    {
+        if (!error.isEmpty()) {
+            qDebug() << "backup failed" << error;
+            QFile::remove(partName);
+        }
+
+        result.error = error;
+        result.finishedAt = QDateTime::currentDateTime();
+        result.msecs = timer.elapsed();
+
+        QMutexLocker locker(&m_backupMutex);
+        m_lastBackup = result;
+
+        return result;
+    };
+
+    // a consistent copy of the last commit, with WAL the writers don't have to wait for it
+    {
+        QSqlQuery query(database());
+        query.prepare("VACUUM INTO :file;");
+        query.bindValue(":file", partName);
+        if (!query.exec())
+            return finish(query.lastQuery() + " failed " + query.lastError().text());
+    }
+
+    // make sure what ended up on disk can actually be opened and read back
+    const QString checkName = threadConnectionName() + "-backup";
+    QString checkResult;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", checkName);
+        db.setDatabaseName(partName);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+        if (db.open()) {
+            QSqlQuery query(db);
+            if (query.exec("PRAGMA integrity_check;") && query.next())
+                checkResult = query.value(0).toString();
+            else
+                checkResult = query.lastError().text();
+
+            query.finish();
+            db.close();
+        } else {
+            checkResult = db.lastError().text();
         }
     }
+    QSqlDatabase::removeDatabase(checkName);
+
+    if (checkResult != "ok")
+        return finish(QObject::tr("Integrity check failed: %1").arg(checkResult));
+
+    if (!QFile::rename(partName, result.fileName))
+        return finish(QObject::tr("Couldn't rename %1").arg(partName));
+
+    result.bytes = QFileInfo(result.fileName).size();
+
+    // drop the oldest ones
+    const QStringList backups = dir.entryList({ dbInfo.completeBaseName() + "-*" + BackupSuffix }, QDir::Files, QDir::Name | QDir::Reversed);
+    for (int i = std::max(1, keep); i < backups.size(); ++i)
+        dir.remove(backups[i]);
+
+    return finish(QString());
+}
+
+QStringList SqlManager::diagnostics() const
+{
+    QStringList lines;
+
+    // how well the compressed tables are doing
+    const QList<QPair<QString, QString>> compressedTables =
+    {
+        { "orders",         "SELECT COUNT(*), SUM(LENGTH(data)), SUM(COALESCE(raw_size, LENGTH(data))) FROM orders;"  },
+        { "order_payloads", "SELECT COUNT(*), SUM(LENGTH(payload)), SUM(raw_size) FROM order_payloads;"               },
+    };
+
+    for (const auto &table : compressedTables) {
+        QSqlQuery query(database());
+        if (!query.exec(table.second) || !query.next()) {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+            continue;
+        }
+
+        const qint64 stored = query.value(1).toLongLong();
+        const qint64 raw = query.value(2).toLongLong();
+        lines << QObject::tr("Table %1: %2 rows, %3 KiB stored, %4 KiB uncompressed (%5%)")
+                     .arg(table.first)
+                     .arg(query.value(0).toInt())
+                     .arg(stored / 1024)
+                     .arg(raw / 1024)
+                     .arg((raw > 0) ? (stored * 100 / raw) : 100);
+    }
+
+    // the history against what keeping every version in full would take
+    {
+        QSqlQuery query(database());
+        if (query.exec("SELECT COUNT(*), COUNT(DISTINCT order_id), SUM(LENGTH(delta)), "
+                       "(SELECT AVG(COALESCE(raw_size, LENGTH(data))) FROM orders) FROM order_history;") && query.next()) {
+            const int versions = query.value(0).toInt();
+            const qint64 stored = query.value(2).toLongLong();
+            const qint64 full = qint64(versions * query.value(3).toDouble());
+            lines << QObject::tr("Order history: %1 versions of %2 orders, %3 KiB stored, %4 KiB as full copies")
+                         .arg(versions)
+                         .arg(query.value(1).toInt())
+                         .arg(stored / 1024)
+                         .arg(full / 1024);
+        } else {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        }
+    }
+
+    QMutexLocker locker(&m_backupMutex);
+    if (!m_lastBackup.finishedAt.isValid()) {
+        const QDateTime lastBackup = lastBackupTime();
+        lines << (lastBackup.isValid() ? QObject::tr("Backup: none taken since start, last one from %1").arg(lastBackup.toString())
+                                       : QObject::tr("Backup: none taken yet"));
+    } else if (!m_lastBackup.error.isEmpty()) {
+        lines << QObject::tr("Backup: failed at %1 after %2 ms, %3").arg(m_lastBackup.finishedAt.toString()).arg(m_lastBackup.msecs).arg(m_lastBackup.error);
+    } else {
+        lines << QObject::tr("Backup: %1 KiB in %2 ms at %3, %4")
+                     .arg(m_lastBackup.bytes / 1024)
+                     .arg(m_lastBackup.msecs)
+                     .arg(m_lastBackup.finishedAt.toString(), QDir::toNativeSeparators(m_lastBackup.fileName));
+    }
+
+    return lines;
+}
+
+void SqlManager::restore(Order &order)
+{
+    QList<Order> orders = { order };
+    restore(orders);
+
+    order = orders.first();
+}
+
+void SqlManager::restore(QList<Order> &orders)
+{
+    if (orders.isEmpty())
+        return;
+
+    // one query per table for the whole batch, three per order adds up fast
+    QHash<int, int> indices;
+    QStringList ids;
+    for (int i = 0; i < orders.size(); ++i) {
+        indices.insert(orders[i].id, i);
+        ids << QString::number(orders[i].id);
+    }
+
+    // past a certain size it's cheaper to read everything and drop what we didn't ask for
+    const QString where = (orders.size() > RestoreByIdMax) ? QString() : QString(" WHERE order_id IN (%1)").arg(ids.join(','));
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+
+    // packaging
+    if (!query.exec("SELECT order_id, packaging_id FROM order_packaging" + where + ";")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return;
+    }
+
+    while (query.next()) {
+        const auto it = indices.constFind(query.value(0).toInt());
+        if (it != indices.constEnd())
+            orders[it.value()].packaging = query.value(1).toInt();
+    }
+
+    // order properties
+    if (!query.exec("SELECT order_id, note FROM order_properties" + where + ";")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return;
+    }
+
+    while (query.next()) {
+        const auto it = indices.constFind(query.value(0).toInt());
+        if (it != indices.constEnd())
+            orders[it.value()].note = query.value(1).toString();
+    }
+
+    // order item properties
+    if (!query.exec("SELECT order_id, item_idx, packaged FROM order_item_properties" + where + ";")) {
+        qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+        return;
+    }
+
+    while (query.next()) {
+        const auto it = indices.constFind(query.value(0).toInt());
+        if (it == indices.constEnd())
+            continue;
+
+        // the order might have lost items since this was saved
+        Order &order = orders[it.value()];
+        const int itemIdx = query.value(1).toInt();
+        if ((itemIdx < 0) || (itemIdx >= order.items.size()))
+            continue;
+
+        order.items[itemIdx].packaged = query.value(2).toBool();
+    }
+
+    // saves the writer didn't get to yet are newer than what's on disk
+    QMutexLocker locker(&m_pendingMutex);
+    for (auto it = m_pendingSaves.cbegin(); it != m_pendingSaves.cend(); ++it) {
+        const auto idx = indices.constFind(it.key());
+        if (idx == indices.constEnd())
+            continue;
+
+        Order &order = orders[idx.value()];
+        const Order &saved = it.value().order;
+        if (saved.dirty & Order::PackagingDirty)
+            order.packaging = saved.packaging;
+
+        if (saved.dirty & Order::NoteDirty)
+            order.note = saved.note;
+
+        for (int i = 0; i < std::min(order.items.size(), saved.items.size()); ++i) {
+            if (saved.items[i].dirty)
+                order.items[i].packaged = saved.items[i].packaged;
+        }
+    }
+}
+
+void SqlManager::save(const Order &order)
+{
+    save(QList<Order>{ order });
+}
+
+void SqlManager::save(const QList<Order> &orders)
+{
+    if (orders.isEmpty())
+        return;
+
+    // queued for the writer thread, restore() already sees them before they're committed
+    bool queued = false;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        for (const Order &order : orders) {
+            // nothing local changed, nothing to write
+            if (!order.isDirty())
+                continue;
+
+            // a change that is still waiting stays dirty, even if this save is about another field
+            PendingSave &pending = m_pendingSaves[order.id];
+            const Order previous = pending.order;
+
+            pending.order = order;
+            pending.order.dirty |= previous.dirty;
+            for (int i = 0; i < std::min(pending.order.items.size(), previous.items.size()); ++i)
+                pending.order.items[i].dirty |= previous.items[i].dirty;
+
+            pending.seq = ++m_pendingSeq;
+            queued = true;
+        }
+    }
+
+    if (!queued)
+        return;
+
+    if (!m_writer) {
+        commitPending();
+        return;
+    }
+
+    QMetaObject::invokeMethod(m_writer, [this]()
+    {
+        if (!m_commitTimer->isActive())
+            m_commitTimer->start();
+    }, Qt::QueuedConnection);
+}
+
+void SqlManager::flush()
+{
+    if (!m_writer || (QThread::currentThread() == m_writerThread)) {
+        commitPending();
+        return;
+    }
+
+    QMetaObject::invokeMethod(m_writer, [this]()
+    {
+        m_commitTimer->stop();
+        commitPending();
+    }, Qt::BlockingQueuedConnection);
+}
+
+QFuture<bool> SqlManager::setCachedPageAsync(const QString &key, const int limit, const CachedPage &page)
+{
+    // compressing the body and trimming the table both happen on the database thread
+    return runAsync([this, key, limit, page]()
+    {
+        return setCachedPage(key, limit, page);
+    });
+}
+
+QFuture<bool> SqlManager::prunePageCacheAsync(const int limit)
+{
+    // queued behind the pages still being cached, so none of the old size slip through
+    return runAsync([this, limit]()
+    {
+        return prunePageCache(limit);
+    });
+}
+
+QFuture<SqlManager::Backup> SqlManager::backupAsync(const int keep)
+{
+    // on a read-only connection, VACUUM INTO still writes the copy but can't touch the database itself
+    return readAsync([this, keep]() { return backup(keep); });
+}
+
+QFuture<QList<Packaging>> SqlManager::packagingsAsync()
+{
+    return readAsync([this]() { return packagings(); });
+}
+
+void SqlManager::markReadOnlyThread()
+{
+    readOnlyThread = true;
 }
 
 QList<Packaging> SqlManager::packagings() const
 {
     QList<Packaging> result;
 
-    QSqlQuery query;
+    QSqlQuery query(database());
     if (!query.exec("SELECT * FROM packaging_types ORDER BY id;")) {
         qDebug() << query.lastQuery() << "failed" << query.lastError().text();
         return result;
@@ -174,7 +1110,7 @@ QList<Packaging> SqlManager::packagings() const
 
 bool SqlManager::updatePackaging(const Packaging &pack)
 {
-    QSqlQuery query;
+    QSqlQuery query(database());
     if (pack.id == -1) {
         query.prepare("INSERT OR REPLACE INTO packaging_types (`name`, `stock`, `restock_url`) VALUES (:name, :stock, :restock_url);");
     } else {
@@ -196,7 +1132,7 @@ bool SqlManager::updatePackaging(const Packaging &pack)
 
 bool SqlManager::removePackaging(const int id)
 {
-    QSqlQuery query;
+    QSqlQuery query(database());
     query.prepare("DELETE FROM packaging_types WHERE id = :id;");
     query.bindValue(":id", id);
 
@@ -210,7 +1146,9 @@ bool SqlManager::removePackaging(const int id)
 
 int SqlManager::ordersWithPackaging(const int id)
 {
-    QSqlQuery query;
+    flush();
+
+    QSqlQuery query(database());
     query.prepare("SELECT COUNT(*) FROM order_packaging WHERE packaging_id = :id;");
     query.bindValue(":id", id);
 
@@ -229,7 +1167,7 @@ int SqlManager::ordersWithPackaging(const int id)
 
 int SqlManager::packagingStock(const int id)
 {
-    QSqlQuery query;
+    QSqlQuery query(database());
     query.prepare("SELECT stock FROM packaging_types WHERE id = :id;");
     query.bindValue(":id", id);
 
@@ -248,7 +1186,7 @@ int SqlManager::packagingStock(const int id)
 
 bool SqlManager::setPackagingStock(const int id, const int stock)
 {
-    QSqlQuery query;
+    QSqlQuery query(database());
     query.prepare("UPDATE packaging_types SET stock = :stock WHERE id = :id;");
     query.bindValue(":stock", stock);
     query.bindValue(":id", id);
@@ -261,29 +1199,158 @@ bool SqlManager::setPackagingStock(const int id, const int stock)
     return true;
 }
 
+void SqlManager::commitPending()
+{
+    QHash<int, PendingSave> pending;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        pending = m_pendingSaves;
+    }
+
+    if (pending.isEmpty())
+        return;
+
+    // everything that piled up goes in one transaction
+    QSqlDatabase db = database();
+    if (!db.transaction())
+        qDebug() << "transaction failed" << db.lastError().text();
+
+    for (const PendingSave &save : pending) {
+        if (!saveProperties(save.order)) {
+            db.rollback();
+            return;
+        }
+    }
+
+    if (!db.commit()) {
+        qDebug() << "commit failed" << db.lastError().text();
+        db.rollback();
+        return;
+    }
+
+    // orders saved again in the meantime stay for the next round
+    QMutexLocker locker(&m_pendingMutex);
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it) {
+        if (m_pendingSaves.value(it.key()).seq == it.value().seq)
+            m_pendingSaves.remove(it.key());
+    }
+}
+
+bool SqlManager::saveProperties(const Order &order)
+{
+    // only the rows that changed, the rest is already on disk
+    if (order.dirty & Order::PackagingDirty) {
+        QSqlQuery &query = (order.packaging > -1)
+                ? preparedQuery("INSERT OR REPLACE INTO order_packaging (`order_id`, `packaging_id`) VALUES (:order_id, :packaging_id);")
+                : preparedQuery("DELETE FROM order_packaging WHERE order_id = :order_id;");
+        if (order.packaging > -1)
+            query.bindValue(":packaging_id", order.packaging);
+
+        query.bindValue(":order_id", order.id);
+        if (!query.exec()) {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+            return false;
+        }
+    }
+
+    if (order.dirty & Order::NoteDirty) {
+        QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO order_properties (`order_id`, `note`) VALUES (:order_id, :note);");
+        query.bindValue(":order_id", order.id);
+        query.bindValue(":note", order.note);
+        if (!query.exec()) {
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+            return false;
+        }
+    }
+
+    if (order.dirty & Order::ItemsDirty) {
+        QSqlQuery &query = preparedQuery("INSERT OR REPLACE INTO order_item_properties (`order_id`, `item_idx`, `packaged`) VALUES (:order_id, :item_idx, :packaged);");
+        for (int i = 0; i < order.items.count(); ++i) {
+            if (!order.items[i].dirty)
+                continue;
+
+            query.bindValue(":order_id", order.id);
+            query.bindValue(":item_idx", i);
+            query.bindValue(":packaged", order.items[i].packaged);
+            if (!query.exec()) {
+                qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 QPair<bool, QString> SqlManager::processTables()
 {
-    QSqlDatabase db = QSqlDatabase::database();
+    QSqlDatabase db = database();
+    bool migrated = false;
 
     for (const TableInfo &tableInfo : TableInformation) {
-        const int tableVer = tableVersion(tableInfo.name);
+        Q_ASSERT(tableInfo.upgrades.size() == (tableInfo.version - 1));
 
-        if (tableVer == -1) { // table doesn't exist
-            const QSqlQuery query = db.exec(QString("CREATE TABLE %1 %2;").arg(tableInfo.name, tableInfo.sql));
-            if (query.lastError().isValid())
-                return qMakePair(false, query.lastError().text());
+        const int tableVer = tableVersion(tableInfo.name);
 
-            const QPair<bool, QString> res = setTableVersion(tableInfo.name, tableInfo.version);
-            if (!res.first)
-                return res;
-        } else if (tableVer > tableInfo.version) { // table newer than expected (woah)
+        if (tableVer > tableInfo.version) { // table newer than expected (woah)
             return qMakePair(false, QObject::tr("Your database seems to be newer than this version of Lectronizer supports.\n"
                                                 "You have to either upgrade Lectronizer or delete the database file.\n"
                                                 "Sorry for the inconvenience."));
-        } else if(tableVer < tableInfo.version) { // table older than expected
-            // TODO: upgrade
+        } else if (tableVer < tableInfo.version) { // table doesn't exist or is older than expected
+            const QPair<bool, QString> res = migrateTable(tableInfo, tableVer);
+            if (!res.first)
+                return res;
+
+            migrated = true;
         }
     }
 
+    // the query planner only knows about the new indexes once they have statistics
+    if (migrated) {
+        QSqlQuery query(db);
+        if (!query.exec("ANALYZE;"))
+            qDebug() << query.lastQuery() << "failed" << query.lastError().text();
+    }
+
+    return qMakePair(true, QString{});
+}
+
+QPair<bool, QString> SqlManager::migrateTable(const TableInfo &tableInfo, const int fromVersion)
+{
+    QSqlDatabase db = database();
+
+    // either the table ends up at the new version or nothing changes
+    if (!db.transaction())
+        return qMakePair(false, db.lastError().text());
+
+    const auto fail = [&db](const QString &error)
+    {
+        db.rollback();
+        return qMakePair(false, error);
+    };
+
+    QStringList statements;
+    if (fromVersion == -1) { // table doesn't exist
+        statements << QString("CREATE TABLE %1 %2;").arg(tableInfo.name, tableInfo.sql);
+    } else {
+        for (int ver = fromVersion; ver < tableInfo.version; ++ver)
+            statements << tableInfo.upgrades.value(ver - 1);
+    }
+
+    statements << tableInfo.indexes;
+
+    for (const QString &statement : statements) {
+        QSqlQuery query(db);
+        if (!query.exec(statement))
+            return fail(statement + " failed " + query.lastError().text());
+    }
+
+    const QPair<bool, QString> res = setTableVersion(tableInfo.name, tableInfo.version);
+    if (!res.first)
+        return fail(res.second);
+
+    if (!db.commit())
+        return fail(db.lastError().text());
+
     return qMakePair(true, QString{});
 }
@@ -1,9 +1,19 @@
 #pragma once
 
+#include "structs.h"
+
+#include <QDateTime>
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
 #include <QObject>
+#include <QSqlDatabase>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
-struct Order;
-struct Packaging;
+class QSqlQuery;
+class QThread;
+class QTimer;
 
 class SqlManager : public QObject
 {
@@ -15,21 +25,103 @@ class SqlManager : public QObject
             QString name{};
             int version{};
             QString sql{};
+            QList<QStringList> upgrades{}; // upgrades[n] takes the table from version n + 1 to n + 2
+            QStringList indexes{};         // created with the table and after every upgrade
         };
 
         static QList<TableInfo> TableInformation;
 
+        struct CachedPage
+        {
+            QByteArray etag{};
+            QByteArray lastModified{};
+            QByteArray body{};
+        };
+
+        struct Mutation
+        {
+            int id{};
+            int orderId{};
+            QByteArray body{};
+            QDateTime createdAt{};
+        };
+
+        struct Backup
+        {
+            QString fileName{};
+            QDateTime finishedAt{};
+            qint64 bytes{};
+            qint64 msecs{};
+            QString error{};
+        };
+
+    private:
+        struct PendingSave
+        {
+            Order order{};
+            quint64 seq{};
+        };
+
     public:
         explicit SqlManager(const QString &dbPath, QObject *parent = nullptr);
         ~SqlManager() override;
 
         QPair<bool, QString> init();
 
+        QSqlDatabase database() const;
+        void closeThreadDatabase();
+
         int tableVersion(const QString &tableName);
         QPair<bool, QString> setTableVersion(const QString &tableName, const int version);
 
+        QString syncValue(const QString &key) const;
+        bool setSyncValue(const QString &key, const QString &value);
+
+        CachedPage cachedPage(const QString &key) const;
+        bool setCachedPage(const QString &key, const int limit, const CachedPage &page);
+        bool prunePageCache(const int limit);
+
+        QList<Mutation> mutations() const;
+        Mutation addMutation(const int orderId, const QByteArray &body);
+        bool removeMutation(const int id);
+
+        QList<Order> storedOrders() const;
+        // the orders, their raw JSON and their hashes go in together or not at all
+        bool storeOrders(const QList<Order> &orders, const QHash<int, QByteArray> &payloads = {}, const QHash<int, quint64> &hashes = {});
+        qint64 ordersGeneration() const;
+
+        // the order as the server had it at that time, only every change is stored and not the whole order
+        Order orderAt(const int orderId, const QDateTime &time) const;
+
+        QHash<int, quint64> orderHashes() const;
+
+        // the raw API JSON of every order, compressed with qCompress
+        QByteArray orderPayload(const int orderId) const;
+
+        QString snapshotPath() const;
+
+        QString backupDir() const;
+        QDateTime lastBackupTime() const;
+        Backup backup(const int keep);
+
+        QStringList diagnostics() const;
+
         void restore(Order &order);
+        void restore(QList<Order> &orders);
         void save(const Order &order);
+        void save(const QList<Order> &orders);
+        void flush();
+
+        // the async versions run on their own threads and connections, so the caller doesn't wait for the disk
+        template<typename Function>
+        auto runAsync(Function function);
+        template<typename Function>
+        auto readAsync(Function function);
+
+        QFuture<bool> setCachedPageAsync(const QString &key, const int limit, const CachedPage &page);
+        QFuture<bool> prunePageCacheAsync(const int limit);
+        QFuture<Backup> backupAsync(const int keep);
+        QFuture<QList<Packaging>> packagingsAsync();
 
         QList<Packaging> packagings() const;
         bool updatePackaging(const Packaging &pack);
@@ -41,8 +133,48 @@ class SqlManager : public QObject
         bool setPackagingStock(const int id, const int stock);
 
     private:
+        static void markReadOnlyThread();
+        QSqlQuery &preparedQuery(const QString &sql) const;
+        void commitPending();
+        bool saveProperties(const Order &order);
+        bool historyOrder(const int orderId, const QDateTime &time, Order &order) const;
+        bool storeHistory(const Order &order);
+        bool writeOrderHashes(const QHash<int, quint64> &hashes);
+        bool writeOrderPayloads(const QHash<int, QByteArray> &payloads);
+        bool addHistory(const int orderId, const QDateTime &changedAt, const QByteArray &delta);
         QPair<bool, QString> processTables();
+        QPair<bool, QString> migrateTable(const TableInfo &tableInfo, const int fromVersion);
 
     private:
+        mutable QMutex m_backupMutex{};
+        QTimer *m_commitTimer{};
         QString m_dbPath{};
+        QThreadPool m_dbPool{};
+        Backup m_lastBackup{};
+        QMutex m_pendingMutex{};
+        QHash<int, PendingSave> m_pendingSaves{};
+        quint64 m_pendingSeq{};
+        mutable QHash<QString, QHash<QString, QSqlQuery*>> m_preparedQueries{};
+        mutable QMutex m_queryMutex{};
+        QThreadPool m_readPool{};
+        QObject *m_writer{};
+        QThread *m_writerThread{};
 };
+
+// read-only connections that run side by side, anything that writes fails here
+// one dedicated thread, so whatever is queued here runs in order and can write
+template<typename Function>
+auto SqlManager::runAsync(Function function)
+{
+    return QtConcurrent::run(&m_dbPool, function);
+}
+
+template<typename Function>
+auto SqlManager::readAsync(Function function)
+{
+    return QtConcurrent::run(&m_readPool, [function]()
+    {
+        markReadOnlyThread();
+        return function();
+    });
+}
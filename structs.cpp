@@ -5,6 +5,7 @@
 #include <QDesktopServices>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QMap>
 #include <QUrl>
 
 QDebug operator<<(QDebug debug, const Address &a)
@@ -198,6 +199,222 @@ Item parseJsonItem(const QJsonValue &val)
     return item;
 }
 
+// only the api fields, the rest comes from SqlManager::restore()
+QDataStream &operator<<(QDataStream &stream, const Address &a)
+{
+    return stream << a.firstName << a.lastName << a.organization << a.street << a.streetExtension
+                  << a.postalCode << a.city << a.state << a.country << a.countryCode;
+}
+
+QDataStream &operator>>(QDataStream &stream, Address &a)
+{
+    return stream >> a.firstName >> a.lastName >> a.organization >> a.street >> a.streetExtension
+                  >> a.postalCode >> a.city >> a.state >> a.country >> a.countryCode;
+}
+
+QDataStream &operator<<(QDataStream &stream, const ItemOption &op)
+{
+    return stream << op.sku << op.name << op.choice << op.weight;
+}
+
+QDataStream &operator>>(QDataStream &stream, ItemOption &op)
+{
+    return stream >> op.sku >> op.name >> op.choice >> op.weight;
+}
+
+QDataStream &operator<<(QDataStream &stream, const Item &it)
+{
+    return stream << it.product.id << it.product.name << it.product.sku << it.product.description
+                  << it.options << it.qty << it.price << it.discount << it.weight;
+}
+
+QDataStream &operator>>(QDataStream &stream, Item &it)
+{
+    return stream >> it.product.id >> it.product.name >> it.product.sku >> it.product.description
+                  >> it.options >> it.qty >> it.price >> it.discount >> it.weight;
+}
+
+QDataStream &operator<<(QDataStream &stream, const Order &o)
+{
+    return stream << o.billing.address << o.billing.useShippingAddress
+                  << o.id << o.currency << o.subtotal << o.taxableAmount << o.total << o.payout << o.lectronzFee << o.paymentFee
+                  << o.payment.provider << o.payment.reference
+                  << o.createdAt << o.updatedAt << o.fulfilledAt << o.fulfillUntil
+                  << o.status << o.storeId << o.storeUrl << o.customerLegalStatus << o.customerEmail << o.customerPhone << o.customerNote
+                  << o.items << o.discountCodes
+                  << o.tax.appliesToShipping << o.tax.rate << o.tax.total << o.tax.collected << o.tax.number
+                  << o.shipping.address << o.shipping.cost << o.shipping.method
+                  << o.tracking.required << o.tracking.code << o.tracking.url
+                  << o.weight.unit << o.weight.total << o.weight.base;
+}
+
+QDataStream &operator>>(QDataStream &stream, Order &o)
+{
+    return stream >> o.billing.address >> o.billing.useShippingAddress
+                  >> o.id >> o.currency >> o.subtotal >> o.taxableAmount >> o.total >> o.payout >> o.lectronzFee >> o.paymentFee
+                  >> o.payment.provider >> o.payment.reference
+                  >> o.createdAt >> o.updatedAt >> o.fulfilledAt >> o.fulfillUntil
+                  >> o.status >> o.storeId >> o.storeUrl >> o.customerLegalStatus >> o.customerEmail >> o.customerPhone >> o.customerNote
+                  >> o.items >> o.discountCodes
+                  >> o.tax.appliesToShipping >> o.tax.rate >> o.tax.total >> o.tax.collected >> o.tax.number
+                  >> o.shipping.address >> o.shipping.cost >> o.shipping.method
+                  >> o.tracking.required >> o.tracking.code >> o.tracking.url
+                  >> o.weight.unit >> o.weight.total >> o.weight.base;
+}
+
+enum class OrderField : quint8
+{
+    BillingAddress = 0,
+    UseShippingAddress,
+    Currency,
+    Subtotal,
+    TaxableAmount,
+    Total,
+    Payout,
+    LectronzFee,
+    PaymentFee,
+    Payment,
+    CreatedAt,
+    UpdatedAt,
+    FulfilledAt,
+    FulfillUntil,
+    Status,
+    StoreId,
+    StoreUrl,
+    CustomerLegalStatus,
+    CustomerEmail,
+    CustomerPhone,
+    CustomerNote,
+    Items,
+    DiscountCodes,
+    Tax,
+    ShippingAddress,
+    ShippingCost,
+    ShippingMethod,
+    Tracking,
+    Weight,
+};
+
+// bump when a field changes meaning, older deltas can't be applied anymore
+static const quint8 OrderDeltaVersion = 1;
+
+// every server field of the order, small ones on their own so a status change doesn't carry the items along
+template<typename OrderType, typename Visitor>
+static void visitOrderFields(OrderType &o, Visitor &&visit)
+{
+    visit(OrderField::BillingAddress,      o.billing.address);
+    visit(OrderField::UseShippingAddress,  o.billing.useShippingAddress);
+    visit(OrderField::Currency,            o.currency);
+    visit(OrderField::Subtotal,            o.subtotal);
+    visit(OrderField::TaxableAmount,       o.taxableAmount);
+    visit(OrderField::Total,               o.total);
+    visit(OrderField::Payout,              o.payout);
+    visit(OrderField::LectronzFee,         o.lectronzFee);
+    visit(OrderField::PaymentFee,          o.paymentFee);
+    visit(OrderField::Payment,             o.payment.provider, o.payment.reference);
+    visit(OrderField::CreatedAt,           o.createdAt);
+    visit(OrderField::UpdatedAt,           o.updatedAt);
+    visit(OrderField::FulfilledAt,         o.fulfilledAt);
+    visit(OrderField::FulfillUntil,        o.fulfillUntil);
+    visit(OrderField::Status,              o.status);
+    visit(OrderField::StoreId,             o.storeId);
+    visit(OrderField::StoreUrl,            o.storeUrl);
+    visit(OrderField::CustomerLegalStatus, o.customerLegalStatus);
+    visit(OrderField::CustomerEmail,       o.customerEmail);
+    visit(OrderField::CustomerPhone,       o.customerPhone);
+    visit(OrderField::CustomerNote,        o.customerNote);
+    visit(OrderField::Items,               o.items);
+    visit(OrderField::DiscountCodes,       o.discountCodes);
+    visit(OrderField::Tax,                 o.tax.appliesToShipping, o.tax.rate, o.tax.total, o.tax.collected, o.tax.number);
+    visit(OrderField::ShippingAddress,     o.shipping.address);
+    visit(OrderField::ShippingCost,        o.shipping.cost);
+    visit(OrderField::ShippingMethod,      o.shipping.method);
+    visit(OrderField::Tracking,            o.tracking.required, o.tracking.code, o.tracking.url);
+    visit(OrderField::Weight,              o.weight.unit, o.weight.total, o.weight.base);
+}
+
+static QMap<OrderField, QByteArray> orderFields(const Order &order)
+{
+    QMap<OrderField, QByteArray> fields;
+    visitOrderFields(order, [&fields](const OrderField field, const auto &...values)
+    {
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(StreamVersion);
+        (stream << ... << values);
+
+        fields.insert(field, data);
+    });
+
+    return fields;
+}
+
+QByteArray orderDelta(const Order &from, const Order &to)
+{
+    const QMap<OrderField, QByteArray> oldFields = orderFields(from);
+    const QMap<OrderField, QByteArray> newFields = orderFields(to);
+
+    QMap<OrderField, QByteArray> changed;
+    for (auto it = newFields.cbegin(); it != newFields.cend(); ++it) {
+        if (oldFields.value(it.key()) != it.value())
+            changed.insert(it.key(), it.value());
+    }
+
+    if (changed.isEmpty())
+        return QByteArray();
+
+    QByteArray delta;
+    QDataStream stream(&delta, QIODevice::WriteOnly);
+    stream.setVersion(StreamVersion);
+    stream << OrderDeltaVersion << quint8(changed.size());
+
+    for (auto it = changed.cbegin(); it != changed.cend(); ++it)
+        stream << quint8(it.key()) << it.value();
+
+    return delta;
+}
+
+bool applyOrderDelta(Order &order, const QByteArray &delta)
+{
+    QDataStream stream(delta);
+    stream.setVersion(StreamVersion);
+
+    quint8 version = 0;
+    quint8 count = 0;
+    stream >> version >> count;
+    if (version != OrderDeltaVersion)
+        return false;
+
+    QMap<OrderField, QByteArray> changes;
+    for (int i = 0; i < count; ++i) {
+        quint8 field = 0;
+        QByteArray data;
+        stream >> field >> data;
+
+        changes.insert(OrderField(field), data);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    bool ok = true;
+    visitOrderFields(order, [&changes, &ok](const OrderField field, auto &...values)
+    {
+        const auto it = changes.constFind(field);
+        if (it == changes.constEnd())
+            return;
+
+        QDataStream fieldStream(it.value());
+        fieldStream.setVersion(StreamVersion);
+        (fieldStream >> ... >> values);
+
+        if (fieldStream.status() != QDataStream::Ok)
+            ok = false;
+    });
+
+    return ok;
+}
+
 Order parseJsonOrder(const QJsonValue &val)
 {
     Order order = {};
@@ -266,6 +483,47 @@ Order parseJsonOrder(const QJsonValue &val)
     return order;
 }
 
+void Order::setNote(const QString &newNote)
+{
+    if (note == newNote)
+        return;
+
+    note = newNote;
+    dirty |= NoteDirty;
+}
+
+void Order::setPackaging(const int packId)
+{
+    if (packaging == packId)
+        return;
+
+    packaging = packId;
+    dirty |= PackagingDirty;
+}
+
+void Order::setItemPackaged(const int itemIdx, const bool isPackaged)
+{
+    if ((itemIdx < 0) || (itemIdx >= items.size()) || (items[itemIdx].packaged == isPackaged))
+        return;
+
+    items[itemIdx].packaged = isPackaged;
+    items[itemIdx].dirty = true;
+    dirty |= ItemsDirty;
+}
+
+bool Order::isDirty() const
+{
+    return dirty != 0;
+}
+
+void Order::clearDirty()
+{
+    dirty = 0;
+
+    for (Item &item : items)
+        item.dirty = false;
+}
+
 bool Order::isRefunded() const
 {
     return status == "refunded";
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <QDataStream>
 #include <QDateTime>
 #include <QDebug>
 #include <QJsonValue>
 #include <QString>
 
+// everything we write with QDataStream uses this, it has to exist in the oldest Qt we support
+static const QDataStream::Version StreamVersion = QDataStream::Qt_5_12;
+
 struct Address
 {
     QString firstName{};
@@ -29,6 +33,8 @@ struct Address
     }
 };
 QDebug operator<<(QDebug debug, const Address &a);
+QDataStream &operator<<(QDataStream &stream, const Address &a);
+QDataStream &operator>>(QDataStream &stream, Address &a);
 
 struct ItemOption
 {
@@ -44,6 +50,8 @@ struct ItemOption
     }
 };
 QDebug operator<<(QDebug debug, const ItemOption &op);
+QDataStream &operator<<(QDataStream &stream, const ItemOption &op);
+QDataStream &operator>>(QDataStream &stream, ItemOption &op);
 
 struct Item
 {
@@ -68,6 +76,7 @@ struct Item
     double weight{};
 
     bool packaged{}; // non-api
+    bool dirty{}; // non-api, packaged changed since the last save
 
     bool operator==(const Item &other) const
     {
@@ -76,6 +85,8 @@ struct Item
     }
 };
 QDebug operator<<(QDebug debug, const Item &it);
+QDataStream &operator<<(QDataStream &stream, const Item &it);
+QDataStream &operator>>(QDataStream &stream, Item &it);
 
 enum class OrderStatus
 {
@@ -88,6 +99,14 @@ enum class OrderStatus
 
 struct Order
 {
+    // which of the non-api fields changed since the last save
+    enum DirtyFlag : quint8
+    {
+        NoteDirty      = 0x01,
+        PackagingDirty = 0x02,
+        ItemsDirty     = 0x04,
+    };
+
     struct Billing
     {
         Address address{};
@@ -194,6 +213,13 @@ struct Order
 
     int packaging{-1}; // non-api
     QString note{}; // non-api
+    quint8 dirty{}; // non-api
+
+    void setNote(const QString &newNote);
+    void setPackaging(const int packId);
+    void setItemPackaged(const int itemIdx, const bool isPackaged);
+    bool isDirty() const;
+    void clearDirty();
 
     bool isRefunded() const;
     bool isShipped() const;
@@ -226,9 +252,22 @@ struct Order
     bool operator!=(const Order &other) const { return !(*this == other); };
 };
 QDebug operator<<(QDebug debug, const Order &o);
+QDataStream &operator<<(QDataStream &stream, const Order &o);
+QDataStream &operator>>(QDataStream &stream, Order &o);
+
+// only the fields that differ between the two versions, empty when nothing the server sends changed
+QByteArray orderDelta(const Order &from, const Order &to);
+bool applyOrderDelta(Order &order, const QByteArray &delta);
 
 Order parseJsonOrder(const QJsonValue &val);
 
+struct Fulfillment
+{
+    int orderId{};
+    QString trackingNo{};
+    QString trackingUrl{};
+};
+
 struct Packaging
 {
     int id{};
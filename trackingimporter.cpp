@@ -0,0 +1,148 @@
+#include "trackingimporter.h"
+#include "ordermanager.h"
+#include "shareddata.h"
+
+#include <QFile>
+#include <QSet>
+
+TrackingImporter::TrackingImporter(OrderManager *orderMgr, SharedData *shared)
+    : m_orderMgr{orderMgr}
+    , m_shared{shared}
+{
+
+}
+
+TrackingImporter::Result TrackingImporter::import(const QString &fileName) const
+{
+    Result result;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        result.error = file.errorString();
+        return result;
+    }
+
+    QSet<int> seenIds;
+    char sep = 0;
+    int lineNo = 0;
+
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        lineNo += 1;
+
+        // spreadsheet apps like to start the file with a BOM
+        if ((lineNo == 1) && line.startsWith("\xEF\xBB\xBF"))
+            line.remove(0, 3);
+
+        if (line.isEmpty())
+            continue;
+
+        // the first line with anything on it decides the separator, and it might be a header
+        const bool firstLine = (sep == 0);
+        if (firstLine)
+            sep = detectSeparator(line);
+
+        const QList<QByteArray> fields = splitLine(line, sep);
+        const QByteArray idField = fields.value(0).trimmed();
+
+        bool ok = false;
+        const int id = (idField.startsWith('#') ? idField.mid(1) : idField).toInt(&ok);
+        if (!ok && firstLine)
+            continue;
+
+        result.rows += 1;
+
+        if (!ok) {
+            result.rejected << tr("Line %1: \"%2\" is not an order number").arg(lineNo).arg(QString::fromUtf8(idField));
+            continue;
+        }
+
+        if (!m_orderMgr->contains(id)) {
+            result.rejected << tr("Line %1: order #%2 doesn't exist, maybe refresh the orders first").arg(lineNo).arg(id);
+            continue;
+        }
+
+        if (m_orderMgr->order(id).isShipped()) {
+            result.rejected << tr("Line %1: order #%2 is already shipped").arg(lineNo).arg(id);
+            continue;
+        }
+
+        if (seenIds.contains(id)) {
+            result.rejected << tr("Line %1: order #%2 is listed more than once").arg(lineNo).arg(id);
+            continue;
+        }
+
+        const QString trackingNo = QString::fromUtf8(fields.value(1).trimmed());
+        if (trackingNo.isEmpty()) {
+            result.rejected << tr("Line %1: order #%2 has no tracking number").arg(lineNo).arg(id);
+            continue;
+        }
+
+        // use the URL from the file if there is one, otherwise fill in the template like MarkShippedDialog does
+        QString trackingUrl = QString::fromUtf8(fields.value(2).trimmed());
+        if (trackingUrl.isEmpty() && !m_shared->trackingUrl.isEmpty()) {
+            trackingUrl = m_shared->trackingUrl;
+            trackingUrl.replace("{#}", trackingNo);
+        }
+
+        seenIds.insert(id);
+        result.fulfillments << Fulfillment{ id, trackingNo, trackingUrl };
+    }
+
+    return result;
+}
+
+QList<QByteArray> TrackingImporter::splitLine(const QByteArray &line, const char sep) const
+{
+    QList<QByteArray> fields;
+    QByteArray field;
+    bool quoted = false;
+
+    for (qsizetype i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+
+        if (quoted) {
+            if (c != '"') {
+                field += c;
+            } else if ((i + 1 < line.size()) && (line[i + 1] == '"')) {
+                // escaped quote
+                field += '"';
+                ++i;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == sep) {
+            fields << field;
+            field.clear();
+        } else {
+            field += c;
+        }
+    }
+
+    fields << field;
+
+    return fields;
+}
+
+char TrackingImporter::detectSeparator(const QByteArray &line) const
+{
+    char sep = ',';
+    switch (m_shared->csvSeparator) {
+    case BulkExporterDialog::SepComma:      sep = ',';  break;
+    case BulkExporterDialog::SepSemicolon:  sep = ';';  break;
+    case BulkExporterDialog::SepTab:        sep = '\t'; break;
+    }
+
+    // stick to the one from the settings, unless the file clearly uses another one
+    if (line.contains(sep))
+        return sep;
+
+    for (const char other : { ',', ';', '\t' }) {
+        if (line.contains(other))
+            return other;
+    }
+
+    return sep;
+}
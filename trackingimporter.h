@@ -0,0 +1,38 @@
+#pragma once
+
+#include "structs.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+class OrderManager;
+struct SharedData;
+
+// Reads the "order id, tracking code[, tracking url]" CSV files carriers give out after printing labels.
+// The file is read line by line, so it doesn't matter how long it is.
+class TrackingImporter
+{
+    Q_DECLARE_TR_FUNCTIONS(TrackingImporter)
+
+    public:
+        struct Result
+        {
+            QString error{};
+            int rows{};
+            QList<Fulfillment> fulfillments{};
+            QStringList rejected{};
+        };
+
+    public:
+        TrackingImporter(OrderManager *orderMgr, SharedData *shared);
+
+        Result import(const QString &fileName) const;
+
+    private:
+        QList<QByteArray> splitLine(const QByteArray &line, const char sep) const;
+        char detectSeparator(const QByteArray &line) const;
+
+    private:
+        OrderManager *m_orderMgr{};
+        SharedData *m_shared{};
+};
@@ -397,3 +397,14 @@ QString shortenUsState(const QString &country, const QString &state)
 
     return usStateCodes.value(state.toLower(), state);
 }
+
+quint64 fnv1a64(const char *data, const qsizetype size)
+{
+    quint64 hash = 0xcbf29ce484222325ull;
+    for (qsizetype i = 0; i < size; ++i) {
+        hash ^= (uchar)data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
@@ -7,3 +7,4 @@
 QString textDate(const QDateTime &date, const SharedData &shared);
 QString sanitizePhoneNumber(const QString &phone, const QString &country, const SharedData &shared);
 QString shortenUsState(const QString &country, const QString &state);
+quint64 fnv1a64(const char *data, const qsizetype size);
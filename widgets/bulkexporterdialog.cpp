@@ -178,6 +178,9 @@ BulkExporterDialog::BulkExporterDialog(OrderManager *orderMgr, QSortFilterProxyM
 {
     m_ui->setupUi(this);
 
+    // needed for every exported order, so read it once in the background
+    m_packagings = m_sqlMgr->packagingsAsync();
+
     m_ui->buttonBox->button(QDialogButtonBox::Save)->setText(tr("Export"));
 
     for (int i = 0; i < m_proxyModel->rowCount(); ++i)
@@ -556,7 +559,7 @@ QVariant BulkExporterDialog::valueForOrderColumn(const int id, const ColumnId &c
         discountTotal = item.discount * item.qty;
 
     QString packaging = tr("Unpackaged");
-    for (const Packaging &pack : m_sqlMgr->packagings()) {
+    for (const Packaging &pack : m_packagings.result()) {
         if (pack.id == order.packaging) {
             packaging = pack.name;
             break;
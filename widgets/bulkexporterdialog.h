@@ -1,6 +1,9 @@
 #pragma once
 
+#include "structs.h"
+
 #include <QDialog>
+#include <QFuture>
 
 namespace Ui { class BulkExporterDialog; }
 
@@ -56,6 +59,7 @@ class BulkExporterDialog : public QDialog
         QString m_lastSaveDir{};
         QList<int> m_orderIds{};
         OrderManager *m_orderMgr{};
+        QFuture<QList<Packaging>> m_packagings{};
         QSortFilterProxyModel *m_proxyModel{};
         SharedData *m_shared{};
         SqlManager *m_sqlMgr{};
@@ -9,17 +9,25 @@
 #include "settingsdialog.h"
 #include "sqlmanager.h"
 #include "statisticsdialog.h"
+#include "trackingimporter.h"
 #include "ui_mainwindow.h"
 #include "utils.h"
 
 #include <QClipboard>
 #include <QCloseEvent>
 #include <QDesktopServices>
+#include <QFileDialog>
+#include <QHash>
 #include <QMessageBox>
 #include <QNetworkAccessManager>
+#include <QSet>
+#include <QSignalBlocker>
 #include <QSystemTrayIcon>
 #include <QTimer>
 
+// how often to check whether a backup is due
+static const int BackupCheckMs = 10 * 60 * 1000;
+
 MainWindow::MainWindow(SqlManager *sqlMgr, QWidget *parent)
     : QMainWindow{parent}
     , m_firstFetch{true}
@@ -64,6 +72,7 @@ MainWindow::MainWindow(SqlManager *sqlMgr, QWidget *parent)
     m_orderModel.setHorizontalHeaderItem((int)ModelColumn::Weight,      new QStandardItem(tr("Weight")));
 
     m_orderProxyModel.setSourceModel(&m_orderModel);
+    m_orderProxyModel.setSearchIndex(&m_orderMgr->searchIndex());
     m_ui->orderTree->setModel(&m_orderProxyModel);
 
     // Maybe make these settings later?
@@ -88,6 +97,10 @@ MainWindow::MainWindow(SqlManager *sqlMgr, QWidget *parent)
     connectSignals();
     readSettings();
 
+    // show what we had last time right away, the first refresh only has to bring in the changes
+    connect(m_orderMgr, &OrderManager::storedOrdersLoaded, m_ui->filterTree, &FilterTreeWidget::refreshFilters);
+    m_orderMgr->loadStoredOrders();
+
     // sets initial filter
     updateDateFilter();
 
@@ -95,6 +108,8 @@ MainWindow::MainWindow(SqlManager *sqlMgr, QWidget *parent)
 
     // Force the timer to calculate midnight
     m_dailySyncTimer.start(100);
+
+    m_backupTimer.start(BackupCheckMs);
 }
 
 MainWindow::~MainWindow()
@@ -199,6 +214,9 @@ void MainWindow::fetchCurrencyRates()
 
     m_shared.currencyRates = dlg.rates();
 
+    // the stored orders were shown before the rates were known
+    syncAllOrderRows();
+
     QTimer::singleShot(100, m_ui->orderRefreshOrdersAction, &QAction::trigger);
 }
 
@@ -406,6 +424,11 @@ void MainWindow::connectSignals()
         statusBar()->showMessage(tr("Refreshing orders..."));
         m_orderMgr->refresh(isHidden() || isMinimized());
     });
+    connect(m_ui->orderFullResyncAction, &QAction::triggered, this, [this]()
+    {
+        statusBar()->showMessage(tr("Resyncing all orders..."));
+        m_orderMgr->refresh(isHidden() || isMinimized(), true);
+    });
 
     // Order context menu
     connect(m_ui->orderTree, &QHeaderView::customContextMenuRequested, this, [this](const QPoint &pos)
@@ -454,7 +477,9 @@ void MainWindow::connectSignals()
         BulkExporterDialog dlg(m_orderMgr, &m_orderProxyModel, m_sqlMgr, &m_shared, this);
         dlg.exec();
     });
+    connect(m_ui->toolsImportTrackingAction, &QAction::triggered, this, &MainWindow::importTrackingNumbers);
     connect(m_ui->toolsSettingsAction, &QAction::triggered, this, &MainWindow::showSettingsDialog);
+    connect(m_ui->helpDiagnosticsAction, &QAction::triggered, this, &MainWindow::showDiagnosticsDialog);
     connect(m_ui->helpAboutAction, &QAction::triggered, this, &MainWindow::showAboutDialog);
 
     // Pass filter changes to the filter model
@@ -473,8 +498,7 @@ void MainWindow::connectSignals()
     // Search bar
     connect(m_ui->orderSearchEdit, &QLineEdit::textChanged, this, [this](const QString &text)
     {
-        m_orderProxyModel.setFilterFixedString(text);
-        m_orderProxyModel.invalidate();
+        m_orderProxyModel.setSearchText(text);
     });
 
     const auto createColumnMenu = [this](QMenu *menu)
@@ -554,8 +578,9 @@ void MainWindow::connectSignals()
     connect(m_ui->detailWidget, &OrderDetailsWidget::hideRequested, m_ui->detailScroll, &QWidget::hide);
 
     // New and updated orders
-    connect(m_orderMgr, &OrderManager::orderReceived, this, &MainWindow::addOrder);
+    connect(m_orderMgr, &OrderManager::ordersReceived, this, &MainWindow::addOrders);
     connect(m_orderMgr, &OrderManager::orderUpdated, this, &MainWindow::updateOrder);
+    connect(m_orderMgr, &OrderManager::ordersUpdated, this, &MainWindow::updateOrders);
     connect(m_orderMgr, &OrderManager::refreshCompleted, this, [this](const int newOrders, const int updatedOrders)
     {
        m_ui->filterTree->refreshFilters();
@@ -585,10 +610,35 @@ void MainWindow::connectSignals()
     {
         statusBar()->showMessage(tr("Order refresh failed: %1").arg(errorStr), 5000);
     });
+    connect(m_orderMgr, &OrderManager::fulfillmentFinished, this, [this](const int orderId, const QString &errorStr)
+    {
+        if (errorStr.isEmpty()) {
+            statusBar()->showMessage(tr("Order #%1 marked as shipped").arg(orderId));
+        } else {
+            statusBar()->showMessage(tr("Failed to mark order #%1 as shipped: %2").arg(orderId).arg(errorStr));
+        }
+    });
+    connect(m_orderMgr, &OrderManager::fulfillmentsCompleted, this, [this](const int shipped, const int failed)
+    {
+        if (failed > 0) {
+            statusBar()->showMessage(tr("%n order(s) marked as shipped, %1 failed", "", shipped).arg(failed), 5000);
+        } else {
+            statusBar()->showMessage(tr("%n order(s) marked as shipped", "", shipped), 5000);
+        }
+    });
+    // the index is updated before the rows are, so the matches are fresh by the time the rows are filtered again
+    connect(m_orderMgr, &OrderManager::searchIndexChanged, &m_orderProxyModel, &OrderSortFilterModel::refreshSearch);
+    connect(m_orderMgr, &OrderManager::updatesQueued, this, [this](const int count)
+    {
+        statusBar()->showMessage(tr("Can't reach the server, %n order update(s) will be sent once it's back", "", count));
+    });
 
     // Auto refresh timer
     connect(&m_autoFetchTimer, &QTimer::timeout, m_ui->orderRefreshOrdersAction, &QAction::trigger);
 
+    // Backup timer, only checks if the last backup is old enough
+    connect(&m_backupTimer, &QTimer::timeout, this, &MainWindow::backupIfDue);
+
     // Daily row sync timer
     connect(&m_dailySyncTimer, &QTimer::timeout, [this]()
     {
@@ -647,6 +697,13 @@ void MainWindow::readSettings()
     m_shared.trackingUrl             = set.value("trackingUrl").toString();
     m_shared.csvSeparator            = set.value("csvSeparator").toInt();
     m_shared.groupOrderDetailWindows = set.value("groupOrderDetailWindows").toBool();
+    m_shared.fetchConcurrency        = set.value("fetchConcurrency", 4).toInt();
+    m_shared.fullSyncIntervalHours   = set.value("fullSyncIntervalHours", 24).toInt();
+    m_shared.fetchSizeMin            = set.value("fetchSizeMin", 50).toInt();
+    m_shared.fetchSizeMax            = set.value("fetchSizeMax", 500).toInt();
+    m_shared.updateConcurrency       = set.value("updateConcurrency", 4).toInt();
+    m_shared.backupIntervalHours     = set.value("backupIntervalHours", 24).toInt();
+    m_shared.backupsKept             = set.value("backupsKept", 7).toInt();
 
     m_shared.phoneRemoveDashes       = set.value("phoneRemoveDashes", true).toBool();
     m_shared.phoneRemoveSpaces       = set.value("phoneRemoveSpaces", true).toBool();
@@ -695,6 +752,13 @@ void MainWindow::writeSettings() const
     set.setValue("trackingUrl",             m_shared.trackingUrl);
     set.setValue("csvSeparator",            m_shared.csvSeparator);
     set.setValue("groupOrderDetailWindows", m_shared.groupOrderDetailWindows);
+    set.setValue("fetchConcurrency",        m_shared.fetchConcurrency);
+    set.setValue("fullSyncIntervalHours",   m_shared.fullSyncIntervalHours);
+    set.setValue("fetchSizeMin",            m_shared.fetchSizeMin);
+    set.setValue("fetchSizeMax",            m_shared.fetchSizeMax);
+    set.setValue("updateConcurrency",       m_shared.updateConcurrency);
+    set.setValue("backupIntervalHours",     m_shared.backupIntervalHours);
+    set.setValue("backupsKept",             m_shared.backupsKept);
 
     set.setValue("phoneRemoveDashes", m_shared.phoneRemoveDashes);
     set.setValue("phoneRemoveSpaces", m_shared.phoneRemoveSpaces);
@@ -837,33 +901,59 @@ QString MainWindow::convertCurrencyString(const double eur)
                 .arg(m_shared.targetCurrency);
 }
 
-void MainWindow::addOrder(const Order &order)
+void MainWindow::addOrders(const QList<Order> &orders)
 {
-    // insert a row of empty items and then sync the order
-    QList<QStandardItem*> rowItems;
-    for (int i = 0; i < (int)ModelColumn::LastValue; ++i)
-        rowItems << new QStandardItem();
+    if (orders.isEmpty())
+        return;
+
+    // sort and filter once the whole batch is in, not after every cell of every row
+    m_orderProxyModel.setDynamicSortFilter(false);
 
-    QStandardItem *rootItem = m_orderModel.invisibleRootItem();
-    rootItem->appendRow(rowItems);
+    // all the rows in one insert, the views only hear about it once
+    const int firstRow = m_orderModel.rowCount();
+    m_orderModel.insertRows(firstRow, (int)orders.size());
 
-    syncOrderRow(rootItem->rowCount() - 1, order);
+    // the new cells are filled quietly and then announced together
+    {
+        const QSignalBlocker blocker(m_orderModel);
+
+        for (int i = 0; i < orders.size(); ++i) {
+            for (int column = 0; column < (int)ModelColumn::LastValue; ++column)
+                m_orderModel.setItem(firstRow + i, column, new QStandardItem());
+
+            syncOrderRow(firstRow + i, orders[i]);
+        }
+    }
+
+    emit m_orderModel.dataChanged(m_orderModel.index(firstRow, 0), m_orderModel.index(m_orderModel.rowCount() - 1, (int)ModelColumn::LastValue - 1));
+
+    m_orderProxyModel.setDynamicSortFilter(true);
+    m_orderProxyModel.invalidate();
 
     updateTreeStatsLabel();
 }
 
 void MainWindow::updateOrder(const Order &order)
 {
+    updateOrders({ order });
+}
+
+void MainWindow::updateOrders(const QList<Order> &orders)
+{
+    // look up the rows once for the whole batch
+    QHash<int, int> rows;
     for (int row = 0; row < m_orderModel.rowCount(); ++row) {
         QStandardItem *idItem = m_orderModel.item(row, 0);
-        const int id = idItem->text().toInt();
-
-        if (id != order.id)
-            continue;
+        rows.insert(idItem->text().toInt(), row);
+    }
 
-        syncOrderRow(row, order);
+    QSet<int> ids;
+    for (const Order &order : orders) {
+        ids.insert(order.id);
 
-        break;
+        const int row = rows.value(order.id, -1);
+        if (row >= 0)
+            syncOrderRow(row, order);
     }
 
     m_ui->filterTree->refreshFilters();
@@ -875,7 +965,7 @@ void MainWindow::updateOrder(const Order &order)
     if (selection->hasSelection()) {
         const QModelIndex proxyCurrent = selection->selection().indexes().first();
         const int id = orderIdFromProxyModel(proxyCurrent);
-        if (id == order.id)
+        if (ids.contains(id))
             updateOrderDetails(selection->selection());
     }
 
@@ -1018,6 +1108,19 @@ void MainWindow::updateAutoFetchTimer()
     m_autoFetchTimer.setSingleShot(false);
 }
 
+void MainWindow::backupIfDue()
+{
+    if ((m_shared.backupIntervalHours <= 0) || m_backup.isRunning())
+        return;
+
+    const QDateTime lastBackup = m_sqlMgr->lastBackupTime();
+    if (lastBackup.isValid() && (lastBackup.secsTo(QDateTime::currentDateTime()) < m_shared.backupIntervalHours * 3600))
+        return;
+
+    // runs on a database thread, the result shows up in the diagnostics
+    m_backup = QFuture<void>(m_sqlMgr->backupAsync(m_shared.backupsKept));
+}
+
 void MainWindow::showSettingsDialog()
 {
     SettingsDialog dlg(m_orderMgr, m_sqlMgr, this);
@@ -1035,6 +1138,51 @@ void MainWindow::showSettingsDialog()
     dlg.exec();
 }
 
+void MainWindow::importTrackingNumbers()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Import tracking numbers"), QString(), tr("CSV files (*.csv);;All files (*)"));
+    if (fileName.isEmpty())
+        return;
+
+    const TrackingImporter importer(m_orderMgr, &m_shared);
+    const TrackingImporter::Result result = importer.import(fileName);
+    if (!result.error.isEmpty()) {
+        QMessageBox::warning(this, tr("Import failed"), tr("Couldn't read the file: %1").arg(result.error));
+        return;
+    }
+
+    QMessageBox msgBox(this);
+    msgBox.setWindowTitle(tr("Import tracking numbers"));
+
+    if (!result.rejected.isEmpty()) {
+        msgBox.setInformativeText(tr("%n row(s) rejected, see the details.", "", (int)result.rejected.size()));
+        msgBox.setDetailedText(result.rejected.join("\n"));
+    }
+
+    if (result.fulfillments.isEmpty()) {
+        msgBox.setIcon(QMessageBox::Warning);
+        msgBox.setText(tr("Nothing to import, none of the %n row(s) can be used.", "", result.rows));
+        msgBox.exec();
+        return;
+    }
+
+    msgBox.setIcon(QMessageBox::Question);
+    msgBox.setText(tr("Mark %n order(s) as shipped?", "", (int)result.fulfillments.size()));
+    msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+    if (msgBox.exec() != QMessageBox::Yes)
+        return;
+
+    statusBar()->showMessage(tr("Marking orders as shipped..."));
+    m_orderMgr->markShipped(result.fulfillments);
+}
+
+void MainWindow::showDiagnosticsDialog()
+{
+    const QStringList lines = m_orderMgr->diagnostics() + m_sqlMgr->diagnostics();
+
+    QMessageBox::information(this, tr("Diagnostics"), lines.join("\n"));
+}
+
 void MainWindow::showAboutDialog()
 {
     const auto compilerVersion = []() -> QString
@@ -4,6 +4,7 @@
 #include "shareddata.h"
 #include "structs.h"
 
+#include <QFuture>
 #include <QItemSelection>
 #include <QMainWindow>
 #include <QStandardItemModel>
@@ -50,18 +51,24 @@ class MainWindow : public QMainWindow
         QString convertCurrencyString(const double eur);
 
     private slots:
-        void addOrder(const Order &order);
+        void addOrders(const QList<Order> &orders);
         void updateOrder(const Order &order);
+        void updateOrders(const QList<Order> &orders);
         void updateDateFilter();
         void updateOrderDetails(const QItemSelection &selected);
         void updateOrderRelatedWidgets();
         void updateTreeStatsLabel();
         void updateAutoFetchTimer();
+        void backupIfDue();
         void showSettingsDialog();
+        void importTrackingNumbers();
+        void showDiagnosticsDialog();
         void showAboutDialog();
 
     private:
         QTimer m_autoFetchTimer{};
+        QFuture<void> m_backup{};
+        QTimer m_backupTimer{};
         QTimer m_dailySyncTimer{};
         bool m_firstFetch{};
         QNetworkAccessManager *m_nam{};
@@ -84,14 +84,7 @@ OrderDetailsWidget::OrderDetailsWidget(const bool standalone, QWidget *parent)
 
     connect(m_ui->noteTextEdit, &QPlainTextEdit::textChanged, this, [this]()
     {
-        const QString note = m_ui->noteTextEdit->toPlainText();
-
-        Order &order = m_orderMgr->order(m_order.id);
-        if (order.note == note)
-            return;
-
-        order.note = note;
-        m_sqlMgr->save(order);
+        m_orderMgr->setNote(m_order.id, m_ui->noteTextEdit->toPlainText());
     });
 }
 
@@ -120,23 +113,9 @@ void OrderDetailsWidget::setOrderManager(OrderManager *orderMgr)
 
     connect(m_orderMgr, &OrderManager::orderUpdated, this, [this](const Order &order)
     {
-        if (order.id == m_order.id)
-            setOrder(order);
-
-        // update packaging combo labels, regardless which order changed
-        for (const Packaging &pack : m_sqlMgr->packagings()) {
-            // start at 2 cause No packaging, and Default packaging have no stock tracking
-            for (int i = 2; i < m_ui->shippingPackagingComboBox->count(); ++i) {
-                const int itemPackId = m_ui->shippingPackagingComboBox->itemData(i).toInt();
-
-                if (itemPackId != pack.id)
-                    continue;
-
-                m_ui->shippingPackagingComboBox->setItemText(i, tr("%1 (%2 left)").arg(pack.name).arg(pack.stock));
-                break;
-            }
-        }
+        updateFromOrders({ order });
     });
+    connect(m_orderMgr, &OrderManager::ordersUpdated, this, &OrderDetailsWidget::updateFromOrders);
 }
 
 void OrderDetailsWidget::setSqlManager(SqlManager *sqlMgr)
@@ -336,6 +315,28 @@ void OrderDetailsWidget::writeSettings(QSettings &set) const
     }
 }
 
+void OrderDetailsWidget::updateFromOrders(const QList<Order> &orders)
+{
+    for (const Order &order : orders) {
+        if (order.id == m_order.id)
+            setOrder(order);
+    }
+
+    // update packaging combo labels, regardless which order changed
+    for (const Packaging &pack : m_sqlMgr->packagings()) {
+        // start at 2 cause No packaging, and Default packaging have no stock tracking
+        for (int i = 2; i < m_ui->shippingPackagingComboBox->count(); ++i) {
+            const int itemPackId = m_ui->shippingPackagingComboBox->itemData(i).toInt();
+
+            if (itemPackId != pack.id)
+                continue;
+
+            m_ui->shippingPackagingComboBox->setItemText(i, tr("%1 (%2 left)").arg(pack.name).arg(pack.stock));
+            break;
+        }
+    }
+}
+
 QVariantList OrderDetailsWidget::saveHeaderStates() const
 {
     QVariantList states;
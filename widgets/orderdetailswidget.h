@@ -38,6 +38,7 @@ class OrderDetailsWidget : public QWidget
         void hideRequested();
 
     private:
+        void updateFromOrders(const QList<Order> &orders);
         QVariantList saveHeaderStates() const;
         void restoreHeaderStates(const QVariantList &states);
 
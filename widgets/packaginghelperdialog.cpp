@@ -237,7 +237,7 @@ PackagingHelperDialog::PackagingHelperDialog(OrderManager *orderMgr, SqlManager
 
         Order &order = m_orderMgr->order(orderId);
         if (order.items[itemIdx].packaged != isPackaged) {
-            order.items[itemIdx].packaged = isPackaged;
+            order.setItemPackaged(itemIdx, isPackaged);
             emit m_orderMgr->orderUpdated(order);
         }
     });
@@ -6,6 +6,10 @@ OrderSettingsPage::OrderSettingsPage(QWidget *parent)
     , m_ui{new Ui::OrderSettingsPage}
 {
     m_ui->setupUi(this);
+
+    // keep the page size range valid
+    connect(m_ui->fetchSizeMinSpinBox, qOverload<int>(&QSpinBox::valueChanged), m_ui->fetchSizeMaxSpinBox, &QSpinBox::setMinimum);
+    connect(m_ui->fetchSizeMaxSpinBox, qOverload<int>(&QSpinBox::valueChanged), m_ui->fetchSizeMinSpinBox, &QSpinBox::setMaximum);
 }
 
 OrderSettingsPage::~OrderSettingsPage()
@@ -32,6 +36,15 @@ void OrderSettingsPage::readSettings(const SharedData &shared)
     m_ui->phonePrefixComboBox->setCurrentIndex(!shared.phoneUsePlusPrefix);
 
     m_ui->groupOrderDetailWindowsCheckBox->setChecked(shared.groupOrderDetailWindows);
+
+    m_ui->fetchConcurrencySpinBox->setValue(shared.fetchConcurrency);
+    m_ui->fullSyncIntervalSpinBox->setValue(shared.fullSyncIntervalHours);
+    m_ui->fetchSizeMinSpinBox->setValue(shared.fetchSizeMin);
+    m_ui->fetchSizeMaxSpinBox->setValue(shared.fetchSizeMax);
+    m_ui->updateConcurrencySpinBox->setValue(shared.updateConcurrency);
+
+    m_ui->backupIntervalSpinBox->setValue(shared.backupIntervalHours);
+    m_ui->backupsKeptSpinBox->setValue(shared.backupsKept);
 }
 
 void OrderSettingsPage::writeSettings(SharedData &shared)
@@ -42,4 +55,13 @@ void OrderSettingsPage::writeSettings(SharedData &shared)
     shared.phoneUsePlusPrefix = (m_ui->phonePrefixComboBox->currentIndex() == 0);
 
     shared.groupOrderDetailWindows = m_ui->groupOrderDetailWindowsCheckBox->isChecked();
+
+    shared.fetchConcurrency = m_ui->fetchConcurrencySpinBox->value();
+    shared.fullSyncIntervalHours = m_ui->fullSyncIntervalSpinBox->value();
+    shared.fetchSizeMin = m_ui->fetchSizeMinSpinBox->value();
+    shared.fetchSizeMax = m_ui->fetchSizeMaxSpinBox->value();
+    shared.updateConcurrency = m_ui->updateConcurrencySpinBox->value();
+
+    shared.backupIntervalHours = m_ui->backupIntervalSpinBox->value();
+    shared.backupsKept = m_ui->backupsKeptSpinBox->value();
 }
@@ -28,6 +28,9 @@ StatisticsDialog::StatisticsDialog(OrderManager *orderMgr, SqlManager *sqlMgr, Q
 {
     m_ui->setupUi(this);
 
+    // read in the background while the other tabs are processed
+    m_packagings = m_sqlMgr->packagingsAsync();
+
     QProgressDialog progressDlg(tr("Gathering data"), tr("Cancel"), 0, 100, this);
     progressDlg.show();
 
@@ -492,6 +495,8 @@ void StatisticsDialog::processWeight()
 
 void StatisticsDialog::processPackaging()
 {
+    const QList<Packaging> packagings = m_packagings.result();
+
     for (const int id : m_orderMgr->orderIds()) {
         const Order &order = m_orderMgr->order(id);
         QString packaging = tr("Default packaging");
@@ -499,7 +504,7 @@ void StatisticsDialog::processPackaging()
         if (order.packaging < 0)
             continue;
 
-        for (const Packaging &pack : m_sqlMgr->packagings()) {
+        for (const Packaging &pack : packagings) {
             if (pack.id != order.packaging)
                 continue;
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "structs.h"
+
 #include <QChartView>
 #include <QDate>
 #include <QDialog>
+#include <QFuture>
 
 namespace Ui { class StatisticsDialog; }
 
@@ -54,5 +57,7 @@ class StatisticsDialog : public QDialog
         QList<QPair<QString, int>> m_weightCounts;
         QList<QPair<QString, int>> m_packagingCounts;
         QList<QPair<QString, int>> m_valueCounts;
+
+        QFuture<QList<Packaging>> m_packagings;
 };
 